@@ -0,0 +1,44 @@
+#ifndef AI_ASSERT_ALL_H
+#define AI_ASSERT_ALL_H
+
+// ai_assert_all(arr, len, x, cond): asserts 'cond' for each element 'x' of arr[0..len), for example
+//   ai_assert_all(a, n, x, x >= 0 && x < n);
+// the check is a reduction over the array which GCC vectorizes (at -O3, or -O2 -fvect-cost-model=cheap: the cheapest
+// model doesn't if-convert), so large buffers are validated at memory speed.
+// only if an element fails, a second, scalar pass finds the first one and asserts 'cond' on it. built with
+// runtime_rewrite.c, the message has its index along with the introspected condition. 'cond' must be pure: it's
+// evaluated for all elements, and twice for the failing one.
+//
+// the plugin does the same for plain loops, for (...; i < n; i++) assert(cond(i)), but only if the condition can't
+// trap, see lower_assert_loop: loads are for this macro, which says 'cond' is fine on all elements. this works
+// without the plugin too.
+
+#include <assert.h>
+#include <stddef.h>
+
+// marks the index of the element an assert checks: "assert((__ai_assert_index(i), cond))". the plugin takes it out
+// of the condition, without the plugin it's discarded by the comma.
+static inline size_t __ai_assert_index(size_t index) {
+    return index;
+}
+
+#define ai_assert_all(arr, len, x, cond) do { \
+    __typeof__(&*(arr)) __ai_arr = (arr); \
+    const size_t __ai_len = (len); \
+    int __ai_ok = 1; \
+    for (size_t __ai_i = 0; __ai_i < __ai_len; __ai_i++) { \
+        const __typeof__(*__ai_arr) x = __ai_arr[__ai_i]; \
+        __ai_ok &= (cond) ? 1 : 0; \
+    } \
+    if (__builtin_expect(!__ai_ok, 0)) { \
+        for (size_t __ai_i = 0; __ai_i < __ai_len; __ai_i++) { \
+            const __typeof__(*__ai_arr) x = __ai_arr[__ai_i]; \
+            if (!(cond)) { \
+                assert((__ai_assert_index(__ai_i), (cond))); \
+                break; \
+            } \
+        } \
+    } \
+} while (0)
+
+#endif
@@ -0,0 +1,70 @@
+// prints the counts of the assert sites of a running program built with the "counters" plugin argument, from the
+// shared memory segment its runtime created ($AI_COUNTERS). doesn't lock anything: the counts are read as they are.
+//
+// build: gcc -o ai_counters ai_counters.c
+// usage: ai_counters <segment name> [interval]
+// with an interval, prints the counts again every 'interval' seconds.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ai_runtime.h"
+
+static void print_counts(const char *segment) {
+    const struct ai_counters_header *header = (const struct ai_counters_header *)segment;
+    const struct ai_counter_entry *entries = (const struct ai_counter_entry *)(segment + AI_COUNTERS_ENTRIES_OFFSET);
+
+    printf("%-16s %-40s %14s %10s  %s\n", "id", "site", "evaluations", "failures", "expression");
+    for (unsigned int i = 0; i < header->nsites; i++) {
+        char site[256];
+        (void)snprintf(site, sizeof(site), "%s:%u", segment + entries[i].file, entries[i].line);
+        printf("%016llx %-40s %14llu %10llu  %s\n", entries[i].id, site,
+            __atomic_load_n(&entries[i].counts.evaluations, __ATOMIC_RELAXED),
+            __atomic_load_n(&entries[i].counts.failures, __ATOMIC_RELAXED), segment + entries[i].expr);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <segment name> [interval]\n", argv[0]);
+        return 1;
+    }
+    unsigned int interval = argc > 2 ? atoi(argv[2]) : 0;
+
+    int fd = shm_open(argv[1], O_RDONLY, 0);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    const char *segment = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    const struct ai_counters_header *header = (const struct ai_counters_header *)segment;
+    if ((size_t)st.st_size < sizeof(*header) || 0 != memcmp(header->magic, AI_COUNTERS_MAGIC, sizeof(AI_COUNTERS_MAGIC)) ||
+        header->entry_size != sizeof(struct ai_counter_entry) || header->size > (unsigned long long)st.st_size) {
+        fprintf(stderr, "%s: not a counters segment\n", argv[1]);
+        return 1;
+    }
+
+    for (;;) {
+        print_counts(segment);
+        if (interval == 0) {
+            break;
+        }
+        sleep(interval);
+        printf("\n");
+    }
+
+    return 0;
+}
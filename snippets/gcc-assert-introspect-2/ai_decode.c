@@ -0,0 +1,180 @@
+// renders the records of a binlog (written by asserts rewritten with output=binlog) or of a journal ($AI_JOURNAL)
+// into the same messages the other output modes print.
+//
+// build: gcc -o ai_decode ai_decode.c ai_format.c
+// not ai_runtime.c: its constructors would act on the $AI_JOURNAL & co. of the environment the decoder runs in.
+// usage: ai_decode <binlog or journal> [sites file]...
+// the sites files are needed for records of output=binlog sites.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ai_runtime.h"
+
+struct site {
+    unsigned long long id;
+    char *desc;
+};
+
+static struct site *sites;
+static size_t nsites;
+
+static int compare_sites(const void *a, const void *b) {
+    const struct site *x = a, *y = b;
+    return x->id < y->id ? -1 : x->id > y->id;
+}
+
+static int compare_records(const void *a, const void *b) {
+    const struct ai_log_record *x = a, *y = b;
+    return x->timestamp < y->timestamp ? -1 : x->timestamp > y->timestamp;
+}
+
+// each line is "<site id, hex>\t<descriptor>".
+static int load_sites_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, f)) > 0) {
+        if (line[len - 1] == '\n') {
+            line[--len] = '\0';
+        }
+
+        char *end;
+        unsigned long long id = strtoull(line, &end, 16);
+        if (*end != '\t') {
+            continue;
+        }
+
+        sites = realloc(sites, (nsites + 1) * sizeof(*sites));
+        sites[nsites].id = id;
+        sites[nsites].desc = strdup(end + 1);
+        nsites++;
+    }
+
+    free(line);
+    fclose(f);
+    return 0;
+}
+
+static const char *find_site(unsigned long long id) {
+    struct site key = { id, NULL };
+    struct site *site = bsearch(&key, sites, nsites, sizeof(*sites), compare_sites);
+    return site != NULL ? site->desc : NULL;
+}
+
+// prints the message of the site 'desc' (or of the unknown 'site'), with the values of a record.
+static void print_message(const char *desc, unsigned long long site, const unsigned long long *record_values,
+    unsigned int nvalues) {
+    if (desc == NULL) {
+        printf("unknown site %016llx\n", site);
+        return;
+    }
+
+    // values of long expressions were truncated when recorded, render them as 0.
+    unsigned long long *values = calloc(nvalues + 1, sizeof(*values));
+    memcpy(values, record_values, (nvalues < AI_LOG_MAX_VALUES ? nvalues : AI_LOG_MAX_VALUES) * sizeof(*values));
+
+    char buf[4096];
+    (void)__ai_format(buf, sizeof(buf), desc, values);
+    printf("%s\n", buf);
+
+    free(values);
+}
+
+static void print_record(const struct ai_log_record *record) {
+    printf("%llu.%09llu [%u] ", record->timestamp / 1000000000ULL, record->timestamp % 1000000000ULL, record->tid);
+    print_message(find_site(record->site), record->site, record->values, record->nvalues);
+}
+
+// prints the finished records of a journal, oldest first. the appends are ordered by their sequence numbers already.
+static int print_journal(const char *path, FILE *f) {
+    struct ai_journal_header header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || header.record_size != sizeof(struct ai_journal_record) ||
+        header.capacity == 0) {
+        fprintf(stderr, "%s: not a journal\n", path);
+        return 1;
+    }
+
+    struct ai_journal_record *records = calloc(header.capacity, sizeof(*records));
+    size_t n = fread(records, sizeof(*records), header.capacity, f);
+
+    unsigned long long first = header.head > header.capacity ? header.head - header.capacity : 0;
+    for (unsigned long long i = first; i < header.head; i++) {
+        const struct ai_journal_record *record = &records[i % header.capacity];
+        if (i % header.capacity >= n || record->seq != i + 1) {
+            // overwritten or unfinished.
+            continue;
+        }
+
+        printf("%llu.%09llu ", record->timestamp / 1000000000ULL, record->timestamp % 1000000000ULL);
+        // the descriptor is guaranteed to be terminated only if the record was finished.
+        const char *desc = record->site != 0 ? find_site(record->site) : record->desc;
+        print_message(desc, record->site, record->values, record->nvalues);
+    }
+
+    free(records);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <binlog or journal> [sites file]...\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = 2; i < argc; i++) {
+        if (load_sites_file(argv[i]) != 0) {
+            return 1;
+        }
+    }
+    qsort(sites, nsites, sizeof(*sites), compare_sites);
+
+    FILE *f = fopen(argv[1], "rb");
+    if (f == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    char magic[8];
+    if (fread(magic, sizeof(magic), 1, f) == 1 && 0 == memcmp(magic, AI_JOURNAL_MAGIC, sizeof(AI_JOURNAL_MAGIC))) {
+        rewind(f);
+        int ret = print_journal(argv[1], f);
+        fclose(f);
+        return ret;
+    }
+    rewind(f);
+
+    struct ai_log_header header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || 0 != memcmp(header.magic, AI_LOG_MAGIC, sizeof(AI_LOG_MAGIC)) ||
+        header.record_size != sizeof(struct ai_log_record)) {
+        fprintf(stderr, "%s: not a binlog\n", argv[1]);
+        return 1;
+    }
+
+    struct ai_log_record *records = NULL;
+    size_t nrecords = 0, cap = 0;
+    struct ai_log_record record;
+    while (fread(&record, sizeof(record), 1, f) == 1) {
+        if (nrecords == cap) {
+            cap = cap ? cap * 2 : 1024;
+            records = realloc(records, cap * sizeof(*records));
+        }
+        records[nrecords++] = record;
+    }
+    fclose(f);
+
+    // each thread's records are already in order, but the threads are dumped one after the other.
+    qsort(records, nrecords, sizeof(*records), compare_records);
+    for (size_t i = 0; i < nrecords; i++) {
+        print_record(&records[i]);
+    }
+
+    return 0;
+}
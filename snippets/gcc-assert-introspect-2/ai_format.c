@@ -0,0 +1,407 @@
+// the formatting half of the runtime: renders values, compare windows and descriptor programs. it has no state and
+// no constructors, so tools reading what a program recorded (ai_decode) link this alone, without ai_runtime.c.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ai_runtime.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// output buffer, snprintf style: 'pos' keeps counting past 'size'.
+struct ai_out {
+    char *buf;
+    size_t size;
+    size_t pos;
+};
+
+static void out_mem(struct ai_out *out, const char *s, size_t len) {
+    if (out->pos < out->size) {
+        size_t n = out->size - out->pos;
+        memcpy(out->buf + out->pos, s, len < n ? len : n);
+    }
+    out->pos += len;
+}
+
+static void out_str(struct ai_out *out, const char *s) {
+    out_mem(out, s, strlen(s));
+}
+
+// formats 'value' in decimal, backwards from 'end' (there must be room for any 64-bit value & a sign before it).
+// returns where the number starts.
+static char *format_u64(char *end, unsigned long long value) {
+    char *p = end;
+
+    do {
+        *--p = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    return p;
+}
+
+static char *format_i64(char *end, long long value) {
+    // negate in unsigned, -LLONG_MIN overflows.
+    char *p = format_u64(end, value < 0 ? -(unsigned long long)value : (unsigned long long)value);
+    if (value < 0) {
+        *--p = '-';
+    }
+    return p;
+}
+
+static char *format_hex(char *end, unsigned long long value) {
+    char *p = end;
+
+    do {
+        *--p = "0123456789abcdef"[value % 16];
+        value /= 16;
+    } while (value != 0);
+    *--p = 'x';
+    *--p = '0';
+    return p;
+}
+
+static void out_value(struct ai_out *out, char kind, unsigned long long value) {
+    char s[32];
+    char *end = s + sizeof(s);
+    char *p;
+    double d;
+
+    switch (kind) {
+    case 'i': p = format_i64(end, (long long)value); break;
+    case 'u': p = format_u64(end, value); break;
+    case 'p': p = format_hex(end, value); break;
+    case 'f':
+        memcpy(&d, &value, sizeof(d));
+        (void)snprintf(s, sizeof(s), "%g", d);
+        out_str(out, s);
+        return;
+    default:
+        out_str(out, "?");
+        return;
+    }
+
+    out_mem(out, p, end - p);
+}
+
+void __ai_fmt_i64(long long value) {
+    char s[32];
+    char *p = format_i64(s + sizeof(s), value);
+    (void)fwrite(p, 1, s + sizeof(s) - p, stdout);
+}
+
+void __ai_fmt_u64(unsigned long long value) {
+    char s[32];
+    char *p = format_u64(s + sizeof(s), value);
+    (void)fwrite(p, 1, s + sizeof(s) - p, stdout);
+}
+
+void __ai_fmt_ptr(const void *value) {
+    char s[32];
+    char *p = format_hex(s + sizeof(s), (unsigned long long)(uintptr_t)value);
+    (void)fwrite(p, 1, s + sizeof(s) - p, stdout);
+}
+
+void __ai_fmt_f64(double value) {
+    // there's no short way to get %g right by hand.
+    (void)printf("%g", value);
+}
+
+size_t __ai_memdiff(const void *a, const void *b, size_t n) {
+    const unsigned char *x = a, *y = b;
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    for (; i + 32 <= n; i += 32) {
+        __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(x + i)),
+            _mm256_loadu_si256((const __m256i *)(y + i)));
+        unsigned int ne = ~(unsigned int)_mm256_movemask_epi8(eq);
+        if (ne != 0) {
+            return i + __builtin_ctz(ne);
+        }
+    }
+#elif defined(__SSE2__)
+    // 64 bytes per test, the exact offset is only looked for in a block that differs.
+    for (; i + 64 <= n; i += 64) {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(x + i)), _mm_loadu_si128((const __m128i *)(y + i)));
+        for (int j = 16; j < 64; j += 16) {
+            eq = _mm_and_si128(eq, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(x + i + j)),
+                _mm_loadu_si128((const __m128i *)(y + i + j))));
+        }
+        if (_mm_movemask_epi8(eq) != 0xffff) {
+            break;
+        }
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(x + i)), _mm_loadu_si128((const __m128i *)(y + i)));
+        unsigned int ne = ~_mm_movemask_epi8(eq) & 0xffff;
+        if (ne != 0) {
+            return i + __builtin_ctz(ne);
+        }
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t ne = vmvnq_u8(vceqq_u8(vld1q_u8(x + i), vld1q_u8(y + i)));
+        // 4 bits per byte of the comparison.
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(ne), 4)), 0);
+        if (mask != 0) {
+            return i + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        if (x[i] != y[i]) {
+            return i;
+        }
+    }
+    return n;
+}
+
+size_t __ai_strdiff(const char *a, const char *b, size_t n) {
+    const unsigned char *x = (const unsigned char *)a, *y = (const unsigned char *)b;
+    size_t i = 0;
+
+    while (i < n) {
+#if defined(__SSE2__)
+        // a load that doesn't cross a page can't fault, even if the string ends before the end of it.
+        if (n - i >= 16 && ((uintptr_t)(x + i) & 4095) <= 4096 - 16 && ((uintptr_t)(y + i) & 4095) <= 4096 - 16) {
+            __m128i xv = _mm_loadu_si128((const __m128i *)(x + i));
+            __m128i yv = _mm_loadu_si128((const __m128i *)(y + i));
+            unsigned int stop = (~_mm_movemask_epi8(_mm_cmpeq_epi8(xv, yv)) |
+                _mm_movemask_epi8(_mm_cmpeq_epi8(xv, _mm_setzero_si128()))) & 0xffff;
+            if (stop != 0) {
+                return i + __builtin_ctz(stop);
+            }
+            i += 16;
+            continue;
+        }
+#endif
+        if (x[i] != y[i] || x[i] == '\0') {
+            return i;
+        }
+        i++;
+    }
+    return n;
+}
+
+// "hh hh ... |ascii|" of p[start, end).
+static void out_window(struct ai_out *out, const unsigned char *p, size_t start, size_t end) {
+    char hex[3] = { 0, 0, ' ' };
+
+    for (size_t i = start; i < end; i++) {
+        hex[0] = "0123456789abcdef"[p[i] >> 4];
+        hex[1] = "0123456789abcdef"[p[i] & 15];
+        out_mem(out, hex, sizeof(hex));
+    }
+    out_str(out, "|");
+    for (size_t i = start; i < end; i++) {
+        char c = p[i] >= 0x20 && p[i] < 0x7f ? p[i] : '.';
+        out_mem(out, &c, 1);
+    }
+    out_str(out, "|");
+}
+
+// the end of the window shown from 'off': 8 bytes, but not past 'n' or the terminator of a string.
+static size_t window_end(const unsigned char *p, size_t off, size_t n, int is_str) {
+    size_t end = off;
+    while (end < n && end < off + 8) {
+        if (is_str && p[end++] == '\0') {
+            break;
+        } else if (!is_str) {
+            end++;
+        }
+    }
+    return end;
+}
+
+size_t __ai_format_cmp(char *buf, size_t size, int kind, const void *a, const void *b, size_t n) {
+    static const char *const names[] = { "memcmp", "bcmp", "strcmp", "strncmp" };
+    struct ai_out out = { buf, size, 0 };
+    const unsigned char *x = a, *y = b;
+    const int is_str = kind == AI_CMP_STRCMP || kind == AI_CMP_STRNCMP;
+    char s[32];
+
+    out_str(&out, kind >= 0 && kind < (int)(sizeof(names) / sizeof(names[0])) ? names[kind] : "?");
+    out_str(&out, "(");
+    out_value(&out, 'p', (uintptr_t)a);
+    out_str(&out, ", ");
+    out_value(&out, 'p', (uintptr_t)b);
+    if (kind == AI_CMP_STRCMP) {
+        n = (size_t)-1;
+    } else {
+        out_str(&out, ", ");
+        out_value(&out, 'u', n);
+    }
+    out_str(&out, ")");
+
+    size_t off = is_str ? __ai_strdiff(a, b, n) : __ai_memdiff(a, b, n);
+    if (off == n || x[off] == y[off]) {
+        // strings that end together.
+        out_str(&out, " [equal]");
+    } else {
+        size_t start = off > 8 ? off - 8 : 0;
+        out_str(&out, " [differ at ");
+        char *p = format_u64(s + sizeof(s), off);
+        out_mem(&out, p, s + sizeof(s) - p);
+        out_str(&out, ": ");
+        out_window(&out, x, start, window_end(x, off, n, is_str));
+        out_str(&out, " vs ");
+        out_window(&out, y, start, window_end(y, off, n, is_str));
+        out_str(&out, "]");
+    }
+
+    if (size > 0) {
+        buf[out.pos < size ? out.pos : size - 1] = '\0';
+    }
+    return out.pos;
+}
+
+void __ai_fmt_cmp(int kind, const void *a, const void *b, size_t n) {
+    char buf[AI_MESSAGE_SIZE];
+
+    size_t len = __ai_format_cmp(buf, sizeof(buf), kind, a, b, n);
+    (void)fwrite(buf, 1, len < sizeof(buf) ? len : sizeof(buf) - 1, stdout);
+}
+
+// position in a descriptor program & its values.
+struct ai_prog {
+    const char *p;
+    const unsigned long long *v;
+};
+
+// skips the expression at the current position, without rendering it.
+static void skip_expr(struct ai_prog *prog) {
+    switch (*prog->p++) {
+    case '&':
+    case '|':
+        prog->v++;
+        skip_expr(prog);
+        skip_expr(prog);
+        break;
+    case 'b':
+        while (*prog->p != '\0' && *prog->p++ != ' ');
+        skip_expr(prog);
+        skip_expr(prog);
+        break;
+    case 'v':
+        if (*prog->p != '\0') {
+            prog->p++;
+        }
+        prog->v++;
+        break;
+    case '@':
+        if (*prog->p != '\0') {
+            prog->p++;
+        }
+        prog->v++;
+        skip_expr(prog);
+        break;
+    default:
+        // malformed, stay on the terminator.
+        prog->p--;
+        break;
+    }
+}
+
+// renders the expression at the current position. this follows the same logic as make_conditional_expr_repr
+// in the plugin, only using the truth values recorded for us instead of re-testing the expressions.
+static void render_expr(struct ai_out *out, struct ai_prog *prog) {
+    const char *op;
+    size_t op_len;
+
+    switch (*prog->p++) {
+    case '&':
+        if (*prog->v++) {
+            skip_expr(prog);
+            out_str(out, "(...) && (");
+            render_expr(out, prog);
+            out_str(out, ")");
+        } else {
+            render_expr(out, prog);
+            skip_expr(prog);
+        }
+        break;
+    case '|':
+        if (*prog->v++) {
+            skip_expr(prog);
+            skip_expr(prog);
+        } else {
+            out_str(out, "(");
+            render_expr(out, prog);
+            out_str(out, ") || (");
+            render_expr(out, prog);
+            out_str(out, ")");
+        }
+        break;
+    case 'b':
+        op = prog->p;
+        while (*prog->p != '\0' && *prog->p != ' ') {
+            prog->p++;
+        }
+        op_len = prog->p - op;
+        if (*prog->p == ' ') {
+            prog->p++;
+        }
+
+        render_expr(out, prog);
+        out_str(out, " ");
+        out_mem(out, op, op_len);
+        out_str(out, " ");
+        render_expr(out, prog);
+        break;
+    case 'v':
+        if (*prog->p != '\0') {
+            out_value(out, *prog->p++, *prog->v++);
+        }
+        break;
+    case '@':
+        if (*prog->p != '\0') {
+            out_str(out, "at index ");
+            out_value(out, *prog->p++, *prog->v++);
+            out_str(out, ": ");
+            render_expr(out, prog);
+        }
+        break;
+    default:
+        prog->p--;
+        out_str(out, "?");
+        break;
+    }
+}
+
+size_t __ai_format(char *buf, size_t size, const char *desc, const unsigned long long *values) {
+    struct ai_out out = { buf, size, 0 };
+
+    const char *tab = strchr(desc, '\t');
+    if (tab != NULL) {
+        // "<file>:<line>: "
+        out_mem(&out, desc, tab - desc);
+        out_str(&out, ": ");
+
+        struct ai_prog prog = { tab + 1, values };
+        render_expr(&out, &prog);
+    } else {
+        out_str(&out, "?");
+    }
+
+    if (size > 0) {
+        buf[out.pos < size ? out.pos : size - 1] = '\0';
+    }
+    return out.pos;
+}
+
+unsigned int __ai_count_values(const char *desc, const unsigned long long *values) {
+    const char *tab = strchr(desc, '\t');
+    if (tab == NULL) {
+        return 0;
+    }
+
+    struct ai_prog prog = { tab + 1, values };
+    skip_expr(&prog);
+    return prog.v - values;
+}
@@ -0,0 +1,347 @@
+// the stateful half of the runtime: the journal, the binlog rings, the soft mode summary and the counters segment,
+// most of them set up by constructors. link it, with ai_format.c, into programs built with the plugin.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ai_runtime.h"
+
+// the journal, if $AI_JOURNAL is set.
+static struct ai_journal_header *ai_journal;
+
+static struct ai_journal_record *ai_journal_records(void) {
+    return (struct ai_journal_record *)(ai_journal + 1);
+}
+
+// runs before main, so the failure path only has to copy into the mapping.
+__attribute__((constructor)) static void ai_journal_init(void) {
+    const char *path = getenv("AI_JOURNAL");
+    if (path == NULL) {
+        return;
+    }
+    const char *capacity_env = getenv("AI_JOURNAL_SIZE");
+    unsigned int capacity = capacity_env != NULL ? strtoul(capacity_env, NULL, 0) : 1024;
+    if (capacity == 0) {
+        capacity = 1024;
+    }
+
+    size_t size = sizeof(struct ai_journal_header) + (size_t)capacity * sizeof(struct ai_journal_record);
+    // never truncate: the file may be the journal of a crash nobody has decoded yet.
+    char pid_path[4096];
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 && errno == EEXIST) {
+        (void)snprintf(pid_path, sizeof(pid_path), "%s.%d", path, (int)getpid());
+        fd = open(pid_path, O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd >= 0) {
+            fprintf(stderr, "%s exists, journaling to %s\n", path, pid_path);
+        }
+        path = pid_path;
+    }
+    if (fd < 0) {
+        perror(path);
+        return;
+    }
+    // allocate the blocks now: a lazily allocated page failing to write back (disk full) would lose the records.
+    struct ai_journal_header *journal = MAP_FAILED;
+    if (posix_fallocate(fd, 0, size) == 0) {
+        journal = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (journal == MAP_FAILED) {
+        perror(path);
+        return;
+    }
+
+    journal->record_size = sizeof(struct ai_journal_record);
+    journal->capacity = capacity;
+    memcpy(journal->magic, AI_JOURNAL_MAGIC, sizeof(AI_JOURNAL_MAGIC));
+    ai_journal = journal;
+}
+
+// clock_gettime goes through the vDSO, it doesn't enter the kernel.
+static void ai_journal_append(unsigned long long site, const char *desc, const unsigned long long *values,
+    unsigned int nvalues) {
+    unsigned long long i = __atomic_fetch_add(&ai_journal->head, 1, __ATOMIC_RELAXED);
+    struct ai_journal_record *record = &ai_journal_records()[i % ai_journal->capacity];
+
+    // claim the slot: a writer that wrapped around onto the same slot makes the reader drop it.
+    __atomic_store_n(&record->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    record->timestamp = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    record->site = site;
+    record->nvalues = nvalues;
+    memcpy(record->values, values, (nvalues < AI_LOG_MAX_VALUES ? nvalues : AI_LOG_MAX_VALUES) * sizeof(*values));
+
+    size_t len = 0;
+    if (desc != NULL) {
+        len = strnlen(desc, sizeof(record->desc) - 1);
+        memcpy(record->desc, desc, len);
+    }
+    record->desc[len] = '\0';
+
+    __atomic_store_n(&record->seq, i + 1, __ATOMIC_RELEASE);
+}
+
+void __ai_report(const char *desc, const unsigned long long *values) {
+    if (ai_journal != NULL) {
+        ai_journal_append(0, desc, values, __ai_count_values(desc, values));
+        return;
+    }
+
+    char buf[AI_MESSAGE_SIZE];
+
+    size_t len = __ai_format(buf, sizeof(buf) - 1, desc, values);
+    if (len > sizeof(buf) - 2) {
+        len = sizeof(buf) - 2;
+    }
+    buf[len++] = '\n';
+
+    // a single write, so messages of concurrent failures don't mix.
+    (void)write(STDERR_FILENO, buf, len);
+}
+
+// a ring of the last AI_LOG_RING_SIZE records logged by a thread. rings are never freed, so records of threads
+// that have exited are dumped as well.
+struct ai_log_ring {
+    struct ai_log_ring *next;
+    // number of records ever logged in this ring.
+    unsigned long long head;
+    unsigned int tid;
+    struct ai_log_record records[AI_LOG_RING_SIZE];
+};
+
+static __thread struct ai_log_ring *ai_log_thread_ring;
+static struct ai_log_ring *ai_log_rings;
+static pthread_once_t ai_log_once = PTHREAD_ONCE_INIT;
+static char ai_log_path[256];
+static int ai_log_dumped;
+static struct sigaction ai_log_prev_sigabrt;
+
+static void write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0) {
+            return;
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+// writes all rings to the binlog file. it's async-signal-safe, because it's also called from SIGABRT.
+static void ai_log_dump(void) {
+    if (__atomic_exchange_n(&ai_log_dumped, 1, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    int fd = open(ai_log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return;
+    }
+
+    struct ai_log_header header = { AI_LOG_MAGIC, sizeof(struct ai_log_record), 0 };
+    write_all(fd, &header, sizeof(header));
+
+    for (struct ai_log_ring *ring = __atomic_load_n(&ai_log_rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+        unsigned long long head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        unsigned long long n = head < AI_LOG_RING_SIZE ? head : AI_LOG_RING_SIZE;
+        unsigned long long first = (head - n) % AI_LOG_RING_SIZE;
+
+        // oldest first: from 'first' to the end of the ring, then from its start.
+        unsigned long long tail = n < AI_LOG_RING_SIZE - first ? n : AI_LOG_RING_SIZE - first;
+        write_all(fd, &ring->records[first], tail * sizeof(struct ai_log_record));
+        write_all(fd, &ring->records[0], (n - tail) * sizeof(struct ai_log_record));
+    }
+
+    close(fd);
+}
+
+static void ai_log_sigabrt(int sig) {
+    ai_log_dump();
+
+    // let the previous disposition (probably the default - terminate) take it from here.
+    sigaction(SIGABRT, &ai_log_prev_sigabrt, NULL);
+    raise(sig);
+}
+
+static void ai_log_init(void) {
+    const char *path = getenv("AI_BINLOG");
+    if (path != NULL) {
+        (void)snprintf(ai_log_path, sizeof(ai_log_path), "%s", path);
+    } else {
+        (void)snprintf(ai_log_path, sizeof(ai_log_path), "ai-%d.binlog", (int)getpid());
+    }
+
+    // failing asserts usually abort, in which case atexit handlers don't run.
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = ai_log_sigabrt;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGABRT, &sa, &ai_log_prev_sigabrt);
+    atexit(ai_log_dump);
+}
+
+static struct ai_log_ring *ai_log_new_ring(void) {
+    pthread_once(&ai_log_once, ai_log_init);
+
+    struct ai_log_ring *ring = mmap(NULL, sizeof(*ring), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        return NULL;
+    }
+    ring->tid = (unsigned int)syscall(SYS_gettid);
+
+    ring->next = __atomic_load_n(&ai_log_rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&ai_log_rings, &ring->next, ring, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    return ring;
+}
+
+void __ai_log(unsigned long long site, const unsigned long long *values, unsigned int nvalues) {
+    if (ai_journal != NULL) {
+        ai_journal_append(site, NULL, values, nvalues);
+        return;
+    }
+
+    struct ai_log_ring *ring = ai_log_thread_ring;
+    if (ring == NULL) {
+        ring = ai_log_thread_ring = ai_log_new_ring();
+        if (ring == NULL) {
+            return;
+        }
+    }
+
+    struct ai_log_record *record = &ring->records[ring->head % AI_LOG_RING_SIZE];
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    record->site = site;
+    record->timestamp = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    record->tid = ring->tid;
+    record->nvalues = nvalues;
+    memcpy(record->values, values, (nvalues < AI_LOG_MAX_VALUES ? nvalues : AI_LOG_MAX_VALUES) * sizeof(*values));
+
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+// the linker defines these for the "ai_soft_sites" section, if there's any site in the program.
+extern struct ai_soft_site __start_ai_soft_sites[] __attribute__((weak));
+extern struct ai_soft_site __stop_ai_soft_sites[] __attribute__((weak));
+
+void __ai_soft_summary(void) {
+    char buf[AI_MESSAGE_SIZE];
+
+    for (struct ai_soft_site *site = __start_ai_soft_sites; site < __stop_ai_soft_sites; site++) {
+        unsigned long long count = __atomic_load_n(&site->count, __ATOMIC_RELAXED);
+        if (count <= site->limit) {
+            // all of them were reported already.
+            continue;
+        }
+
+        int len = snprintf(buf, sizeof(buf), "%s:%u: assertion '%s' failed %llu times (%llu not reported)\n",
+            site->file, site->line, site->expr, count, count - site->limit);
+        if (len > 0) {
+            write_all(STDERR_FILENO, buf, (size_t)len < sizeof(buf) ? (size_t)len : sizeof(buf) - 1);
+        }
+    }
+}
+
+static void *ai_soft_summary_thread(void *arg) {
+    unsigned int interval = (unsigned int)(unsigned long)arg;
+
+    for (;;) {
+        sleep(interval);
+        __ai_soft_summary();
+    }
+    return NULL;
+}
+
+__attribute__((constructor)) static void ai_soft_init(void) {
+    if (&__start_ai_soft_sites[0] == &__stop_ai_soft_sites[0]) {
+        return;
+    }
+
+    atexit(__ai_soft_summary);
+
+    const char *interval = getenv("AI_SOFT_SUMMARY_INTERVAL");
+    if (interval != NULL && atoi(interval) > 0) {
+        pthread_t thread;
+        if (0 == pthread_create(&thread, NULL, ai_soft_summary_thread, (void *)(unsigned long)atoi(interval))) {
+            pthread_detach(thread);
+        }
+    }
+}
+
+// the linker defines these for the "ai_counter_sites" section, if there's any site in the program.
+extern struct ai_counter_site __start_ai_counter_sites[] __attribute__((weak));
+extern struct ai_counter_site __stop_ai_counter_sites[] __attribute__((weak));
+
+__attribute__((constructor)) static void ai_counters_init(void) {
+    const char *name = getenv("AI_COUNTERS");
+    if (name == NULL || &__start_ai_counter_sites[0] == &__stop_ai_counter_sites[0]) {
+        return;
+    }
+
+    size_t nsites = __stop_ai_counter_sites - __start_ai_counter_sites;
+    size_t size = AI_COUNTERS_ENTRIES_OFFSET + nsites * sizeof(struct ai_counter_entry);
+    for (size_t i = 0; i < nsites; i++) {
+        size += strlen(__start_ai_counter_sites[i].file) + 1 + strlen(__start_ai_counter_sites[i].expr) + 1;
+    }
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(name);
+        return;
+    }
+    char *segment = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+        segment = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (segment == MAP_FAILED) {
+        perror(name);
+        return;
+    }
+
+    struct ai_counter_entry *entries = (struct ai_counter_entry *)(segment + AI_COUNTERS_ENTRIES_OFFSET);
+    char *strings = (char *)&entries[nsites];
+    for (size_t i = 0; i < nsites; i++) {
+        struct ai_counter_site *site = &__start_ai_counter_sites[i];
+        struct ai_counter_entry *entry = &entries[i];
+
+        entry->id = site->id;
+        entry->line = site->line;
+        entry->file = strings - segment;
+        strings = stpcpy(strings, site->file) + 1;
+        entry->expr = strings - segment;
+        strings = stpcpy(strings, site->expr) + 1;
+
+        // sites evaluated by constructors which ran before this one have counts already. increments made between
+        // the copy & the switch are lost.
+        entry->counts.evaluations = __atomic_load_n(&site->slot->evaluations, __ATOMIC_RELAXED);
+        entry->counts.failures = __atomic_load_n(&site->slot->failures, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->slot, &entry->counts, __ATOMIC_RELEASE);
+    }
+
+    struct ai_counters_header *header = (struct ai_counters_header *)segment;
+    header->nsites = nsites;
+    header->entry_size = sizeof(struct ai_counter_entry);
+    header->size = size;
+    header->pid = getpid();
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(header->magic, AI_COUNTERS_MAGIC, sizeof(AI_COUNTERS_MAGIC));
+}
@@ -0,0 +1,182 @@
+#ifndef AI_RUNTIME_H
+#define AI_RUNTIME_H
+
+// runtime support for code built with runtime_rewrite.c. link ai_runtime.c and ai_format.c into programs built with
+// a plugin mode that uses them. tools only rendering what a program recorded need ai_format.c alone.
+
+#include <stddef.h>
+
+// size of the stack buffer a failure message is rendered into. longer messages are truncated.
+#define AI_MESSAGE_SIZE 1024
+
+// asserts rewritten with output=printf print each value of the failed condition with one of these: to stdout,
+// like the rest of the message, but without a format string to parse.
+void __ai_fmt_i64(long long value);
+void __ai_fmt_u64(unsigned long long value);
+void __ai_fmt_ptr(const void *value);
+void __ai_fmt_f64(double value);
+
+// asserts rewritten with output=printf or output=write render memcmp/bcmp/strcmp/strncmp calls in their condition
+// with these: the first offset where the buffers differ, and a hex & ASCII window of both around it.
+// 'kind' is one of AI_CMP_*, given by the plugin as a number. 'n' is ignored for strcmp.
+#define AI_CMP_MEMCMP 0
+#define AI_CMP_BCMP 1
+#define AI_CMP_STRCMP 2
+#define AI_CMP_STRNCMP 3
+
+// prints to stdout.
+void __ai_fmt_cmp(int kind, const void *a, const void *b, size_t n);
+// like snprintf: returns the length of the full text, the output is truncated if it's >= size.
+size_t __ai_format_cmp(char *buf, size_t size, int kind, const void *a, const void *b, size_t n);
+
+// the offset of the first byte where 'a' & 'b' differ, or 'n' if they don't. vectorized, so multi-megabyte
+// buffers are scanned at memory speed.
+size_t __ai_memdiff(const void *a, const void *b, size_t n);
+// the same for strings: the first offset where they differ or both end, or 'n'.
+size_t __ai_strdiff(const char *a, const char *b, size_t n);
+
+// asserts rewritten with output=desc call this when they fail, with a constant descriptor of the assert and
+// the values captured from its condition.
+//
+// the descriptor is "<file>:<line>\t<program>", where the program describes the expression in prefix form:
+//   &<left><right>          && expression. consumes a value: the truth value of <left>.
+//   |<left><right>          || expression. consumes a value: the truth value of the whole expression.
+//   b<op> <left><right>     binary operator; <op> is its text ("==", "+", ...), terminated by a space.
+//   v<kind>                 plain value, consumes a value. <kind> is one of:
+//                           i (signed), u (unsigned), p (pointer), f (double, passed by its bits), x (unknown).
+//   @<kind><expr>           assert on an array element (see ai_assert_all.h), consumes a value: the index of the
+//                           element, of the given kind. only at the start of the program.
+// 'values' holds the consumed values, in order of appearance in the program.
+void __ai_report(const char *desc, const unsigned long long *values);
+
+// renders the message for a descriptor & its values into 'buf', the same message the printf mode of the plugin
+// prints. returns the length of the full message; like snprintf, the output is truncated if it's >= size.
+size_t __ai_format(char *buf, size_t size, const char *desc, const unsigned long long *values);
+
+// the number of values the program of a descriptor consumes from 'values', which aren't read.
+unsigned int __ai_count_values(const char *desc, const unsigned long long *values);
+
+// asserts rewritten with output=binlog call this when they fail. it doesn't format anything: it stores a record of
+// the site ID & the values in a ring buffer of the calling thread. the rings are dumped to $AI_BINLOG (default
+// ai-<pid>.binlog) when the process exits or aborts, and ai_decode renders them using the sites files written
+// by the plugin.
+void __ai_log(unsigned long long site, const unsigned long long *values, unsigned int nvalues);
+
+// the binlog file is an ai_log_header, followed by ai_log_records.
+#define AI_LOG_MAGIC "AIBLOG1"
+// records of sites with more values are truncated.
+#define AI_LOG_MAX_VALUES 13
+// records per thread. when a ring is full, the oldest records are overwritten.
+#define AI_LOG_RING_SIZE 4096
+
+struct ai_log_header {
+    char magic[8];
+    unsigned int record_size;
+    unsigned int pad;
+};
+
+struct ai_log_record {
+    unsigned long long site;
+    // CLOCK_REALTIME, in nanoseconds.
+    unsigned long long timestamp;
+    unsigned int tid;
+    // number of values the site has, may be more than AI_LOG_MAX_VALUES.
+    unsigned int nvalues;
+    unsigned long long values[AI_LOG_MAX_VALUES];
+};
+
+// if $AI_JOURNAL is set, __ai_report and __ai_log don't print or buffer anything: they append a record to a journal,
+// a ring of $AI_JOURNAL_SIZE (default 1024) records in a file of that name. the file is created & mapped when the
+// program starts. an existing file is never reused, it may hold the records of an earlier crash: the journal is then
+// "<name>.<pid>" instead (the path is printed to stderr). the file is mapped once, so a failure only copies the
+// record into the mapping: no syscalls, no heap, no stdio. whatever happens next, even a crash, the kernel writes
+// the pages back to the file, and ai_decode renders the records.
+// the file is an ai_journal_header, followed by 'capacity' ai_journal_records.
+#define AI_JOURNAL_MAGIC "AIJRNL1"
+// longer descriptors are truncated.
+#define AI_JOURNAL_DESC_SIZE 256
+
+struct ai_journal_header {
+    char magic[8];
+    unsigned int record_size;
+    unsigned int capacity;
+    // number of records ever appended. record i is at index i % capacity.
+    unsigned long long head;
+};
+
+struct ai_journal_record {
+    // i + 1 for record i, written last: records with a sequence number not matching their index weren't finished.
+    unsigned long long seq;
+    // CLOCK_REALTIME, in nanoseconds.
+    unsigned long long timestamp;
+    // from __ai_log: the site ID, 'desc' is empty. from __ai_report: 0, the descriptor is in 'desc'.
+    unsigned long long site;
+    unsigned int nvalues;
+    unsigned int pad;
+    unsigned long long values[AI_LOG_MAX_VALUES];
+    char desc[AI_JOURNAL_DESC_SIZE];
+};
+
+// asserts rewritten with soft=N don't call __assert_fail. each site gets one of these in the "ai_soft_sites"
+// section: only the first 'limit' failures of a site are reported, the others just increment 'count'.
+struct ai_soft_site {
+    // number of failures, incremented with relaxed atomics.
+    unsigned long long count;
+    const char *expr;
+    const char *file;
+    unsigned int line;
+    unsigned int limit;
+};
+
+// prints to stderr a line per site of the program that has failed more than its limit, with its failure count.
+// it's called at exit, and every $AI_SOFT_SUMMARY_INTERVAL seconds if that's set.
+void __ai_soft_summary(void);
+
+// asserts rewritten with "counters" count how often they're evaluated & how often they fail. each site gets an
+// ai_counter_site in the "ai_counter_sites" section, pointing to its counts. the counts start in a static slot of
+// the site, on a cache line of its own. if $AI_COUNTERS is set, a constructor creates a shared memory segment of
+// that name (see shm_open), and moves the counts of all sites there, where ai_counters (or any other scraper)
+// reads them while the program runs. the segment isn't removed when the program exits.
+//
+// both counts are relaxed atomic increments, so they're exact with threads too, at the cost of a locked instruction
+// on the passing path.
+struct ai_counter_slot {
+    unsigned long long evaluations;
+    unsigned long long failures;
+};
+
+struct ai_counter_site {
+    struct ai_counter_slot *slot;
+    // hash of the location of the site, stable across builds.
+    unsigned long long id;
+    const char *expr;
+    const char *file;
+    unsigned int line;
+    unsigned int pad;
+};
+
+// the segment is an ai_counters_header, the entries at AI_COUNTERS_ENTRIES_OFFSET, then the strings they refer to.
+// the magic is written last, a segment without it is still being set up.
+#define AI_COUNTERS_MAGIC "AICNT1"
+#define AI_COUNTERS_ENTRIES_OFFSET 64
+
+struct ai_counters_header {
+    char magic[8];
+    unsigned int nsites;
+    unsigned int entry_size;
+    unsigned long long size;
+    int pid;
+    unsigned int pad;
+};
+
+struct ai_counter_entry {
+    // updated by the program, the rest is constant.
+    struct ai_counter_slot counts;
+    unsigned long long id;
+    unsigned int line;
+    // offsets of the strings, from the start of the segment.
+    unsigned int file;
+    unsigned int expr;
+} __attribute__((aligned(64)));
+
+#endif
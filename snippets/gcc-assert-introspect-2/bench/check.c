@@ -0,0 +1,44 @@
+// a Check test case (https://libcheck.github.io/check/), for bench/check.sh. ck_assert_msg is expanded as in
+// check.h, the library is left out: _mark_point and _ck_assert_failed count & print instead.
+//
+// usage: check <passes> <fail>
+// asserts on 'passes' elements that hold, then on one that doesn't if 'fail' is 1.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ck_assert_msg(expr, ...) \
+    (expr) ? \
+        _mark_point(__FILE__, __LINE__) : \
+        _ck_assert_failed(__FILE__, __LINE__, "Assertion '"#expr"' failed" , ## __VA_ARGS__, NULL)
+
+static unsigned int marks;
+
+void _mark_point(__attribute__((unused)) const char *file, __attribute__((unused)) int line) {
+    marks++;
+}
+
+__attribute__((noreturn)) void _ck_assert_failed(const char *file, int line, const char *expr, ...) {
+    printf("marks %u\n", marks);
+    printf("%s:%d: %s\n", file, line, expr);
+    fflush(stdout);
+    exit(2);
+}
+
+static void check_below(const int *a, int n, int limit) {
+    for (int i = 0; i < n; i++) {
+        ck_assert_msg(a[i] < limit, "element %d", i);
+    }
+}
+
+int main(int argc, char **argv) {
+    const int passes = argc > 1 ? atoi(argv[1]) : 5;
+    const int fail = argc > 2 ? atoi(argv[2]) : 1;
+
+    int *a = calloc(passes + 1, sizeof(*a));
+    a[passes] = 42;
+    check_below(a, passes + fail, 10);
+    printf("marks %u\n", marks);
+    free(a);
+    return 0;
+}
@@ -0,0 +1,80 @@
+#!/bin/bash
+set -e
+
+# the Check test case of bench/check.c, built with runtime_rewrite & _ck_assert_failed registered as a fail
+# function, with _mark_point as its pass function. checks that the failure is introspected (the report has the
+# failing value), and that the passing asserts still call _mark_point, in each plugin variant.
+#
+# usage: bench/check.sh [-O<level>]
+# VARIANTS overrides the plugin variants (plugin args separated by commas, or "default"). output=binlog isn't
+# among them: its reports are read back by ai_decode.
+# builds everything first, in a temporary directory.
+
+cd "$(dirname "$0")/.."
+OPT=-O2
+while [ $# -gt 0 ]; do
+    case $1 in
+    -O*) OPT=$1 ;;
+    *) echo "unknown argument '$1'" >&2; exit 1 ;;
+    esac
+    shift
+done
+VARIANTS=${VARIANTS:-"default output=write output=desc soft=10 counters mode=assume"}
+PASSES=5
+OUT=$(mktemp -d)
+trap "rm -rf $OUT" EXIT
+
+g++ -O2 -I`gcc -print-file-name=plugin`/include -fpic -shared -o $OUT/runtime_rewrite.so runtime_rewrite.c
+gcc $OPT -c ai_runtime.c -o $OUT/ai_runtime.o
+gcc $OPT -c ai_format.c -o $OUT/ai_format.o
+
+failed=0
+# prints "ok" or what's wrong with the run of the last build: $1 is its output, $2 its exit status, the rest of the
+# args what the output must have.
+expect() {
+    local output=$1 status=$2
+    shift 2
+    if [ "$status" != 0 ] && [ "$status" != 2 ]; then
+        echo "exit status $status"
+        return 1
+    fi
+    for pattern in "$@"; do
+        if ! grep -q -- "$pattern" <<< "$output"; then
+            echo "no '$pattern' in:"
+            echo "$output"
+            return 1
+        fi
+    done
+    echo ok
+}
+
+for variant in $VARIANTS; do
+    args=(-fplugin=$OUT/runtime_rewrite.so -fplugin-arg-runtime_rewrite-fail-fn=_ck_assert_failed:fle:_mark_point)
+    if [ "$variant" != default ]; then
+        IFS=, read -ra kvs <<< "$variant"
+        for kv in "${kvs[@]}"; do
+            args+=("-fplugin-arg-runtime_rewrite-$kv")
+        done
+    fi
+    gcc $OPT "${args[@]}" -c bench/check.c -o $OUT/check.o
+    gcc -o $OUT/check $OUT/check.o $OUT/ai_runtime.o $OUT/ai_format.o -lpthread
+
+    # assume mode doesn't check anything, the passes are still marked.
+    output=$($OUT/check $PASSES 0 2>&1) && status=0 || status=$?
+    result=$(expect "$output" $status "marks $PASSES") || failed=1
+    printf "%-28s %-8s %s\n" "rewrite:$variant" pass "$result"
+    if [ "$variant" == mode=assume ]; then
+        continue
+    fi
+
+    output=$($OUT/check $PASSES 1 2>&1) && status=0 || status=$?
+    case $variant in
+    # the failure is logged, and the test goes on.
+    soft=*) result=$(expect "$output" $status 42 "marks $PASSES") || failed=1 ;;
+    # the rewrite only reported the value, and the original call was made.
+    *) result=$(expect "$output" $status 42 "marks $PASSES" "Assertion 'a\[i\] < limit' failed") || failed=1 ;;
+    esac
+    printf "%-28s %-8s %s\n" "rewrite:$variant" fail "$result"
+done
+
+exit $failed
@@ -0,0 +1,85 @@
+#!/bin/bash
+set -e
+
+# compile time, peak RSS & object size of generated TUs, without a plugin and with each of the rewrite plugins.
+# the TUs vary in the number of functions, the number of asserts per function & the depth of the && / || trees
+# in their conditions.
+#
+# usage: bench/compile.sh [-O<level>] [functions...]
+# defaults to -O2 and 1000 10000 100000 functions. ASSERTS & DEPTHS override the densities and depths tried,
+# PLUGINS the plugins (file names without .c; runtime_rewrite may be given plugin args as runtime_rewrite:key=value,...).
+# builds everything first, in a temporary directory.
+
+cd "$(dirname "$0")/.."
+OPT=-O2
+if [[ $1 == -O* ]]; then
+    OPT=$1
+    shift
+fi
+FUNCTIONS=${@:-1000 10000 100000}
+ASSERTS=${ASSERTS:-1 4}
+DEPTHS=${DEPTHS:-1 4}
+PLUGINS=${PLUGINS:-basic_rewrite complex_rewrite runtime_rewrite runtime_rewrite:output=desc runtime_rewrite:soft=10}
+OUT=$(mktemp -d)
+trap "rm -rf $OUT" EXIT
+
+PLUGIN_INCLUDE=`gcc -print-file-name=plugin`/include
+for plugin in $(printf "%s\n" $PLUGINS | cut -d: -f1 | sort -u); do
+    g++ -O2 -I$PLUGIN_INCLUDE -fpic -shared -o $OUT/$plugin.so $plugin.c
+done
+gcc -O2 -o $OUT/measure bench/measure.c
+
+# writes a TU of 'functions' functions with 'asserts' asserts each to stdout. the conditions are 'depth'
+# comparisons joined by alternating && & ||, so both operators get nested.
+generate() {
+    local functions=$1 asserts=$2 depth=$3
+
+    echo "#include <assert.h>"
+    awk -v functions=$functions -v asserts=$asserts -v depth=$depth 'BEGIN {
+        for (f = 0; f < functions; f++) {
+            printf "int f%d(int *a, int n) {\n    int s = 0;\n", f
+            for (i = 0; i < asserts; i++) {
+                cond = "a[" i " % n] != " f
+                for (d = 1; d < depth; d++) {
+                    cond = "(" cond (d % 2 ? " && " : " || ") "a[" (i + d) " % n] < s + " d ")"
+                }
+                printf "    assert(%s);\n    s += a[%d %% n];\n", cond, i
+            }
+            printf "    return s;\n}\n"
+        }
+    }'
+}
+
+# runs the compile of $1, with the rest of the args passed to gcc. prints wall seconds, peak RSS in KB & object size.
+measure() {
+    local src=$1
+    shift
+    local result
+    result=$($OUT/measure gcc $OPT -c "$@" $src -o $OUT/tu.o 2>&1 >/dev/null | tail -n 1)
+    echo "$result $(stat -c %s $OUT/tu.o)"
+}
+
+printf "%-40s %9s %7s %6s %10s %10s %12s\n" plugin functions asserts depth wall rss_kb object
+for functions in $FUNCTIONS; do
+    for asserts in $ASSERTS; do
+        for depth in $DEPTHS; do
+            src=$OUT/tu_${functions}_${asserts}_${depth}.c
+            generate $functions $asserts $depth > $src
+
+            printf "%-40s %9d %7d %6d %10.2f %10d %12d\n" none $functions $asserts $depth $(measure $src)
+            for plugin in $PLUGINS; do
+                name=${plugin%%:*}
+                args=()
+                if [[ $plugin == *:* ]]; then
+                    IFS=, read -ra kvs <<< "${plugin#*:}"
+                    for kv in "${kvs[@]}"; do
+                        args+=("-fplugin-arg-$name-$kv")
+                    done
+                fi
+                printf "%-40s %9d %7d %6d %10.2f %10d %12d\n" $plugin $functions $asserts $depth \
+                    $(measure $src -fplugin=$OUT/$name.so "${args[@]}")
+            done
+            rm -f $src
+        done
+    done
+done
@@ -0,0 +1,45 @@
+// kernels for bench/fastpath.sh: asserts whose passing path should be the same code as with plain assert.
+// leaves on arguments are evaluated again on the failure path. loads (a[i], p->value) may trap, so
+// leaf_needs_save_expr captures them in SAVE_EXPRs: the check is that those only hold values the passing path computes
+// anyway, and don't cost it anything once optimized.
+
+#include <assert.h>
+#include <stddef.h>
+
+struct node {
+    struct node *next;
+    int value;
+};
+
+// a load the loop uses anyway, captured.
+long kernel_bound(const int *a, int n) {
+    long s = 0;
+    for (int i = 0; i < n; i++) {
+        assert(a[i] < n);
+        s += a[i];
+    }
+    return s;
+}
+
+// dereferences behind a && side, captured: the failure path mustn't evaluate them again if the left side failed.
+long kernel_chase(const struct node *p, int x) {
+    long s = 0;
+    while (p != NULL) {
+        assert(p->value != x && p->next != p);
+        s += p->value;
+        p = p->next;
+    }
+    return s;
+}
+
+// arithmetic on arguments, not captured.
+int kernel_arith(int x, int y, int z) {
+    assert(x * 3 + y != z);
+    return x + y + z;
+}
+
+// an || of comparisons on arguments, not captured.
+int kernel_range(int x, int lo, int hi) {
+    assert(x == 0 || (x > lo && x < hi));
+    return x - lo;
+}
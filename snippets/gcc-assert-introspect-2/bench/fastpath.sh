@@ -0,0 +1,113 @@
+#!/bin/bash
+set -e
+
+# checks that the rewrite leaves the passing path alone: builds the kernels of bench/fastpath.c with plain assert
+# and with runtime_rewrite in each output mode, and diffs the assembly of each kernel without its failure blocks.
+# fails if any kernel differs, and prints the diff.
+#
+# usage: bench/fastpath.sh [-O<level>]
+# a failure block is one that calls __assert_fail or a handler, up to the next label. jumps to them all compare
+# equal, the other local labels are renumbered by first use. VARIANTS overrides the plugin variants (plugin args
+# separated by commas, or "default"); modes changing the passing path on purpose (soft, sample, counters...) aren't
+# expected to match.
+
+cd "$(dirname "$0")/.."
+OPT=-O2
+while [ $# -gt 0 ]; do
+    case $1 in
+    -O*) OPT=$1 ;;
+    *) echo "unknown argument '$1'" >&2; exit 1 ;;
+    esac
+    shift
+done
+VARIANTS=${VARIANTS:-"default output=write output=desc output=binlog"}
+OUT=$(mktemp -d)
+trap "rm -rf $OUT" EXIT
+
+g++ -O2 -I`gcc -print-file-name=plugin`/include -fpic -shared -o $OUT/runtime_rewrite.so runtime_rewrite.c
+
+# writes the assembly of bench/fastpath.c, built with the given args, to $OUT/$1.s
+build() {
+    local name=$1
+    shift
+    gcc $OPT -fno-asynchronous-unwind-tables "$@" -S bench/fastpath.c -o $OUT/$name.s
+}
+
+# prints the passing path of function $2 in assembly $1.
+fast_path() {
+    awk -v fn=$2 '
+    $0 == fn ":" { inside = 1 }
+    !inside { next }
+    $1 == ".size" && $2 == fn "," { inside = 0; flush(); next }
+    # a new block: a local label, or the cold part of the function.
+    /^\.L[0-9]+:/ || $0 == fn ".cold:" { flush() }
+    { block[n++] = $0 }
+    /\tcall\t(__assert_fail|__assert_introspect_fail_)/ { failure = 1 }
+    function flush(   i, label, line, out) {
+        if (n > 0 && failure && block[0] ~ /^\.L[0-9]+:/) {
+            label = block[0]
+            sub(/:$/, "", label)
+            fail[label] = 1
+        } else {
+            for (i = 0; i < n; i++) {
+                kept[nkept++] = block[i]
+            }
+        }
+        n = 0
+        failure = 0
+    }
+    END {
+        for (i = 0; i < nkept; i++) {
+            line = kept[i]
+            # directives & section switches are layout, not code.
+            if (line ~ /^\t\./ || line == fn ".cold:") {
+                continue
+            }
+            out = ""
+            while (match(line, /\.L[0-9]+/)) {
+                label = substr(line, RSTART, RLENGTH)
+                if (label in fail) {
+                    name = "FAIL"
+                } else {
+                    if (!(label in names)) {
+                        names[label] = ".L" nnames++
+                    }
+                    name = names[label]
+                }
+                out = out substr(line, 1, RSTART - 1) name
+                line = substr(line, RSTART + RLENGTH)
+            }
+            print out line
+        }
+    }' $1
+}
+
+build assert
+functions=$(grep -o '^kernel_[a-z_]*:' $OUT/assert.s | tr -d :)
+for fn in $functions; do
+    fast_path $OUT/assert.s $fn > $OUT/assert.$fn
+done
+
+failed=0
+for variant in $VARIANTS; do
+    args=(-fplugin=$OUT/runtime_rewrite.so)
+    if [ "$variant" != default ]; then
+        IFS=, read -ra kvs <<< "$variant"
+        for kv in "${kvs[@]}"; do
+            args+=("-fplugin-arg-runtime_rewrite-$kv")
+        done
+    fi
+    build rewrite "${args[@]}"
+
+    for fn in $functions; do
+        fast_path $OUT/rewrite.s $fn > $OUT/rewrite.$fn
+        if diff -u --label assert --label "rewrite:$variant" $OUT/assert.$fn $OUT/rewrite.$fn; then
+            printf "%-28s %-16s same\n" "rewrite:$variant" $fn
+        else
+            printf "%-28s %-16s DIFFERENT\n" "rewrite:$variant" $fn
+            failed=1
+        fi
+    done
+done
+
+exit $failed
@@ -0,0 +1,124 @@
+// kernels for bench/runtime.sh: hot loops with asserts that always pass, to measure what the rewrite costs on the
+// passing path. only the kernels have asserts, main() just times them.
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../ai_assert_all.h"
+
+#define N 4096
+
+struct node {
+    struct node *next;
+    int value;
+};
+
+static int array[N];
+static struct node nodes[N];
+
+// integer loop, an assert on every iteration.
+__attribute__((noinline)) long kernel_int_loop(const int *a, int n) {
+    long s = 0;
+    for (int i = 0; i < n; i++) {
+        assert(a[i] >= 0 && a[i] < n);
+        s += a[i] * 3 + (s >> 7);
+    }
+    return s;
+}
+
+// pointer chasing, a guard per node.
+__attribute__((noinline)) long kernel_chase(const struct node *p, int x) {
+    long s = 0;
+    while (p != NULL) {
+        assert(p != NULL && p->value != x);
+        s += p->value;
+        p = p->next;
+    }
+    return s;
+}
+
+// vectorizable without asserts: a reduction over the array.
+__attribute__((noinline)) long kernel_vector(const int *a, int n) {
+    long s = 0;
+    for (int i = 0; i < n; i++) {
+        assert(a[i] < n || a[i] == -1);
+        s += a[i];
+    }
+    return s;
+}
+
+// validating a buffer: a loop of nothing but the assert, which the plugin turns into a reduction.
+__attribute__((noinline)) long kernel_validate(const int *a, int n) {
+    for (int i = 0; i < n; i++) {
+        assert(a[i] >= 0 && a[i] < n);
+    }
+    return n;
+}
+
+// the same with ai_assert_all.h, a reduction with or without the plugin.
+__attribute__((noinline)) long kernel_assert_all(const int *a, int n) {
+    ai_assert_all(a, n, x, x >= 0 && x < n);
+    return n;
+}
+
+struct kernel {
+    const char *name;
+    long (*run)(void);
+};
+
+static long run_int_loop(void) { return kernel_int_loop(array, N); }
+static long run_chase(void) { return kernel_chase(&nodes[0], -1); }
+static long run_vector(void) { return kernel_vector(array, N); }
+static long run_validate(void) { return kernel_validate(array, N); }
+static long run_assert_all(void) { return kernel_assert_all(array, N); }
+
+static const struct kernel kernels[] = {
+    { "int_loop", run_int_loop },
+    { "chase", run_chase },
+    { "vector", run_vector },
+    { "validate", run_validate },
+    { "assert_all", run_assert_all },
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// prints "<kernel> <ns per iteration>" for each kernel, the best of 'repeats' runs of 'rounds' rounds.
+int main(int argc, char *argv[]) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 10000;
+    int repeats = argc > 2 ? atoi(argv[2]) : 5;
+
+    // the nodes are linked in a scattered order (2053 is coprime to N), so the loads don't prefetch well. the
+    // chain starts at nodes[0].
+    for (int i = 0; i < N; i++) {
+        array[i] = (i * 7919) % N;
+        nodes[i].value = i;
+    }
+    for (int i = 0; i < N; i++) {
+        nodes[(i * 2053) % N].next = i + 1 < N ? &nodes[((i + 1) * 2053) % N] : NULL;
+    }
+
+    volatile long sink = 0;
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        double best = 0;
+        for (int r = 0; r < repeats; r++) {
+            double start = now();
+            for (int i = 0; i < rounds; i++) {
+                sink += kernels[k].run();
+            }
+            double elapsed = now() - start;
+            if (r == 0 || elapsed < best) {
+                best = elapsed;
+            }
+        }
+        printf("%s %.3f\n", kernels[k].name, best * 1e9 / ((double)rounds * N));
+    }
+
+    return 0;
+}
@@ -0,0 +1,39 @@
+// runs a command & prints its wall time in seconds and its peak RSS in KB, for the bench scripts: there's no
+// /usr/bin/time everywhere.
+//
+// usage: measure <command> [args...]
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <command> [args...]\n", argv[0]);
+        return 1;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        execvp(argv[1], &argv[1]);
+        perror(argv[1]);
+        _exit(127);
+    }
+
+    // the compiler driver forks cc1 & as, their peak is reported in the children's usage.
+    int status;
+    struct rusage usage;
+    if (pid < 0 || wait4(pid, &status, 0, NULL) < 0 || getrusage(RUSAGE_CHILDREN, &usage) != 0) {
+        perror("measure");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    fprintf(stderr, "%.3f %ld\n", (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9, usage.ru_maxrss);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -0,0 +1,60 @@
+#!/bin/bash
+set -e
+
+# compile time of a generated function with deeply nested control flow (if, for, switch & statement expressions,
+# an assert on each level), with & without the plugin. the plugin's share should grow linearly with the depth.
+#
+# usage: bench/nested.sh [depths...]
+# builds the plugin first, everything goes in a temporary directory.
+
+cd "$(dirname "$0")/.."
+DEPTHS=${@:-250 500 1000 2000}
+OUT=$(mktemp -d)
+trap "rm -rf $OUT" EXIT
+
+g++ -O2 -I`gcc -print-file-name=plugin`/include -fpic -shared -o $OUT/runtime_rewrite.so runtime_rewrite.c
+
+# writes a function 'depth' levels deep to stdout.
+generate() {
+    local depth=$1
+
+    echo "#include <assert.h>"
+    echo "int f(int *a, int n) {"
+    echo "    int s = 0;"
+    for ((i = 0; i < depth; i++)); do
+        case $((i % 4)) in
+        0) echo "if (a[$i % n] > s) {" ;;
+        1) echo "for (int i$i = 0; i$i < n; i$i++) {" ;;
+        2) echo "switch (a[$i % n]) { case $i: {" ;;
+        3) echo "({ int t$i = a[$i % n];" ;;
+        esac
+        echo "assert(a[$i % n] != $i && s < n);"
+        echo "s += a[$i % n];"
+    done
+    for ((i = depth - 1; i >= 0; i--)); do
+        case $((i % 4)) in
+        0) echo "}" ;;
+        1) echo "}" ;;
+        2) echo "} }" ;;
+        3) echo "t$i; });" ;;
+        esac
+    done
+    echo "    return s;"
+    echo "}"
+}
+
+# user+sys seconds of compiling $1, with the rest of the args passed to gcc.
+compile_time() {
+    local src=$1
+    shift
+    local TIMEFORMAT="%U %S"
+    { time gcc -O0 -c "$@" $src -o $OUT/nested.o >/dev/null 2>&1; } 2>&1 | awk '{ print $1 + $2 }'
+}
+
+printf "%8s %10s %10s %10s\n" depth base plugin delta
+for depth in $DEPTHS; do
+    generate $depth > $OUT/nested_$depth.c
+    base=$(compile_time $OUT/nested_$depth.c)
+    plugin=$(compile_time $OUT/nested_$depth.c -fplugin=$OUT/runtime_rewrite.so)
+    awk -v d=$depth -v b=$base -v p=$plugin 'BEGIN { printf "%8d %10.2f %10.2f %10.2f\n", d, b, p, p - b }'
+done
@@ -0,0 +1,104 @@
+#!/bin/bash
+set -e
+
+# passing-path cost of the rewrite: the kernels of bench/kernels.c built with plain assert, with NDEBUG & with
+# runtime_rewrite in each of its modes. prints ns/iteration of each kernel & the instruction count of its function,
+# both relative to plain assert.
+#
+# usage: bench/runtime.sh [-O<level>] [--save <file>] [--check <file>]
+# --save writes the ns/iteration results to a file, --check fails if a kernel got slower than in that file by more
+# than $THRESHOLD percent (default 10). ROUNDS & REPEATS are passed to the kernels, VARIANTS overrides the plugin
+# variants (plugin args separated by commas, or "default").
+# builds everything first, in a temporary directory.
+
+cd "$(dirname "$0")/.."
+OPT=-O2
+SAVE=
+CHECK=
+while [ $# -gt 0 ]; do
+    case $1 in
+    -O*) OPT=$1 ;;
+    --save) SAVE=$2; shift ;;
+    --check) CHECK=$2; shift ;;
+    *) echo "unknown argument '$1'" >&2; exit 1 ;;
+    esac
+    shift
+done
+ROUNDS=${ROUNDS:-10000}
+REPEATS=${REPEATS:-5}
+THRESHOLD=${THRESHOLD:-10}
+VARIANTS=${VARIANTS:-"default output=write output=desc output=binlog soft=10 sample=16 counters mode=assume hoist hoist=early"}
+OUT=$(mktemp -d)
+trap "rm -rf $OUT" EXIT
+
+g++ -O2 -I`gcc -print-file-name=plugin`/include -fpic -shared -o $OUT/runtime_rewrite.so runtime_rewrite.c
+gcc $OPT -c ai_runtime.c -o $OUT/ai_runtime.o
+gcc $OPT -c ai_format.c -o $OUT/ai_format.o
+
+# builds bench/kernels.c as variant $1, with the rest of the args passed to gcc.
+build() {
+    local variant=$1
+    shift
+    gcc $OPT "$@" -c bench/kernels.c -o $OUT/$variant.o
+    gcc -o $OUT/$variant $OUT/$variant.o $OUT/ai_runtime.o $OUT/ai_format.o -lpthread
+}
+
+# number of instructions in function $2 of binary $1.
+count_instructions() {
+    objdump -d --no-show-raw-insn --disassemble=$2 $1 | grep -c '^ *[0-9a-f]*:'
+}
+
+names=(assert ndebug)
+build assert
+build ndebug -DNDEBUG
+for variant in $VARIANTS; do
+    args=(-fplugin=$OUT/runtime_rewrite.so)
+    if [ "$variant" != default ]; then
+        IFS=, read -ra kvs <<< "$variant"
+        for kv in "${kvs[@]}"; do
+            args+=("-fplugin-arg-runtime_rewrite-$kv")
+        done
+    fi
+    name=rewrite:$variant
+    names+=($name)
+    build $name "${args[@]}"
+done
+
+declare -A ns insns
+for name in "${names[@]}"; do
+    while read kernel value; do
+        ns[$name,$kernel]=$value
+        insns[$name,$kernel]=$(count_instructions $OUT/$name kernel_$kernel)
+    done < <($OUT/$name $ROUNDS $REPEATS)
+done
+kernels=$($OUT/assert 1 1 | awk '{ print $1 }')
+
+printf "%-28s %-10s %10s %8s %8s %8s\n" variant kernel ns/iter vs.assert insns delta
+for name in "${names[@]}"; do
+    for kernel in $kernels; do
+        awk -v name=$name -v kernel=$kernel -v ns=${ns[$name,$kernel]} -v base=${ns[assert,$kernel]} \
+            -v insns=${insns[$name,$kernel]} -v base_insns=${insns[assert,$kernel]} 'BEGIN {
+            printf "%-28s %-10s %10.3f %+7.1f%% %8d %+8d\n", name, kernel, ns, (ns / base - 1) * 100, insns, insns - base_insns
+        }'
+    done
+done
+
+if [ -n "$SAVE" ]; then
+    for name in "${names[@]}"; do
+        for kernel in $kernels; do
+            echo "$name $kernel ${ns[$name,$kernel]}"
+        done
+    done > $SAVE
+fi
+
+if [ -n "$CHECK" ]; then
+    failed=0
+    while read name kernel value; do
+        current=${ns[$name,$kernel]}
+        if [ -n "$current" ] && awk -v c=$current -v v=$value -v t=$THRESHOLD 'BEGIN { exit !(c > v * (1 + t / 100)) }'; then
+            echo "regression: $name $kernel $value -> $current ns/iter" >&2
+            failed=1
+        fi
+    done < $CHECK
+    exit $failed
+fi
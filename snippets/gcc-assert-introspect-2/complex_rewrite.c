@@ -6,6 +6,7 @@
 #include <plugin-version.h>
 #include <c-family/c-common.h>
 #include <stringpool.h>
+#include <obstack.h>
 
 int plugin_is_GPL_compatible; // must be defined for the plugin to run
 
@@ -31,23 +32,22 @@ static const char *get_expr_op_repr(tree expr) {
     return op;
 }
 
-// the core logic: recursively calls itself for operands of binary operators.
+// the core logic: recursively calls itself for operands of binary operators, appending the format to 'fmt'.
+// each piece is appended once, so this is linear in the size of the expression, and there's no length limit.
 // wtf? c++? vec<..> *& ??
-static char *create_expression_repr(tree expr, vec<tree, va_gc> *&args) {
-    char buf[1024];
-
+static void create_expression_repr(tree expr, vec<tree, va_gc> *&args, struct obstack *fmt) {
     const char *op = get_expr_op_repr(expr);
     // got a binary operator for this expression?
     if (NULL != op) {
-        // then it's binary! descend into its 2 operands.
-        char *left = create_expression_repr(TREE_OPERAND(expr, 0), args);
-        char *right = create_expression_repr(TREE_OPERAND(expr, 1), args);
-        // wrap them up together
-        snprintf(buf, sizeof(buf), "(%s) %s (%s)", left, op, right);
-        free(left);
-        free(right);
-
-        return xstrdup(buf);
+        // then it's binary! descend into its 2 operands, and wrap them up together: "(left) op (right)"
+        obstack_1grow(fmt, '(');
+        create_expression_repr(TREE_OPERAND(expr, 0), args, fmt);
+        obstack_grow(fmt, ") ", 2);
+        obstack_grow(fmt, op, strlen(op));
+        obstack_grow(fmt, " (", 2);
+        create_expression_repr(TREE_OPERAND(expr, 1), args, fmt);
+        obstack_1grow(fmt, ')');
+        return;
     }
 
     // add current expression to arguments list.
@@ -55,18 +55,22 @@ static char *create_expression_repr(tree expr, vec<tree, va_gc> *&args) {
     // order in this list.
     vec_safe_push(args, expr);
     // use %d for everything to keep things simple.
-    return xstrdup("%d");
+    obstack_grow(fmt, "%d", 2);
 }
 
 static void patch_assert(tree cond_expr) {
     vec<tree, va_gc> *v;
     vec_alloc(v, 0);
 
-    char *fmt = create_expression_repr(COND_EXPR_COND(cond_expr), v);
+    struct obstack ob;
+    gcc_obstack_init(&ob);
+    create_expression_repr(COND_EXPR_COND(cond_expr), v, &ob);
+    obstack_1grow(&ob, '\0');
+    char *fmt = (char *)obstack_finish(&ob);
 
     // format comes first.
     vec_safe_insert(v, 0, build_string_literal(strlen(fmt) + 1, fmt));
-    free(fmt);
+    obstack_free(&ob, NULL);
 
     // UNKNOWN_LOCATION? more on that below.
     tree call = build_call_expr_loc_vec(UNKNOWN_LOCATION, lookup_name(get_identifier("printf")), v);
@@ -1,15 +1,221 @@
 #include <stdio.h>
+#include <sys/resource.h>
 
 #include <gcc-plugin.h>
 #include <tree.h>
 #include <tree-iterator.h>
 #include <plugin-version.h>
 #include <c-family/c-common.h>
-#include <c-tree.h>
+#include <c-family/c-pragma.h>
 #include <stringpool.h>
+#include <attribs.h>
+#include <function.h>
+#include <cgraph.h>
+#include <diagnostic-core.h>
+#include <stor-layout.h>
+#include <varasm.h>
+#include <memmodel.h>
+#include <tree-eh.h>
+#include <obstack.h>
+#include <ggc.h>
+#include <hash-map.h>
+#include <tree-pass.h>
+#include <context.h>
+#include <basic-block.h>
+#include <tree-ssa-alias.h>
+#include <internal-fn.h>
+#include <gimple-expr.h>
+#include <gimple.h>
+#include <gimple-iterator.h>
+#include <predict.h>
+#include <cfghooks.h>
+#include <tree-cfg.h>
+#include <ssa.h>
+#include <tree-ssa.h>
+#include <cfgloop.h>
+#include <tree-ssa-loop.h>
+#include <tree-ssa-loop-niter.h>
+#include <tree-scalar-evolution.h>
+#include <tree-into-ssa.h>
+#include <gimplify.h>
+#include <tree-inline.h>
+#include <timevar.h>
 
 int plugin_is_GPL_compatible; // must be defined for the plugin to run
 
+// how the failure message gets out, set by the "output" plugin argument.
+enum output_mode {
+    // printf each part of the message as we walk the expression (the default). values are printed by the
+    // __ai_fmt_* formatters, so ai_format.c has to be linked in.
+    OUTPUT_PRINTF,
+    // collect the message in a stack buffer, then write(2) it to stderr in one go. messages of threads failing
+    // concurrently don't interleave, and nothing is left in stdio buffers when __assert_fail aborts.
+    OUTPUT_WRITE,
+    // don't generate any reporting code: emit a constant descriptor of the expression, and pass it along with
+    // the captured values to __ai_report (see ai_runtime.h), which renders the message.
+    OUTPUT_DESC,
+    // don't format anything on failure: __ai_log (see ai_runtime.h) stores a binary record of the site ID and
+    // values in a per-thread ring. the descriptors go into a sites file, which ai_decode uses to render the
+    // records later.
+    OUTPUT_BINLOG,
+};
+
+static enum output_mode output_mode = OUTPUT_PRINTF;
+// set by the "mode" plugin argument: "check" (the default) rewrites asserts to report their failures, "assume"
+// turns them into optimizer hints, see make_assume.
+static bool assume_mode;
+// cleared by the "no-warn-always-false" plugin argument: warns about asserts folding to false, see rewrite_assert.
+static bool warn_always_false = true;
+
+// soft mode, set by the "soft" plugin argument: if >= 0, failing asserts don't call __assert_fail, and only the
+// first 'soft_limit' failures of each site are reported. the rest are only counted, see __ai_soft_summary.
+static long soft_limit = -1;
+
+// size of the stack buffer used by OUTPUT_WRITE, set by the "buffer-size" plugin argument.
+// longer messages are truncated.
+static unsigned long output_buffer_size = 1024;
+
+// set by the "stats" plugin argument: collect some numbers about the TU, and print them when done. with
+// "stats=<file>", they're written to the file as a JSON object instead. sizes are in bytes, except the size
+// estimate of the generated code, which is in GCC's own units (about an instruction each), see stats.
+static bool print_stats;
+static const char *stats_file;
+
+static struct {
+    // functions pre_genericize_callback looked into, and asserts found in them.
+    unsigned int functions;
+    unsigned int asserts;
+    // assert loops made reductions, see lower_assert_loop.
+    unsigned int loops;
+    // tree nodes the rewrite added to the functions, plus the bodies of the handlers.
+    long tree_nodes;
+    // total size of the string literals we emitted, each counted once.
+    unsigned long literal_bytes;
+    // GCC's size estimate (eni_size_weights, about an instruction per unit, not bytes) of the failure paths and
+    // handlers, see assert_cold_pass.
+    unsigned long size_estimate;
+    // the most function_obstack held while rewriting a function.
+    size_t function_memory_peak;
+} stats;
+
+// strings we keep until the end of the TU: the keys of the literal pool and the names of the handlers.
+static struct obstack tu_obstack;
+// temporary data of the function being rewritten, released once it's done. see pre_genericize_callback.
+static struct obstack function_obstack;
+
+// the walk callback of count_tree_nodes.
+static tree count_tree_nodes_r(tree *tp, int *walk_subtrees, void *data) {
+    (*(long *)data)++;
+    return NULL_TREE;
+}
+
+// number of distinct tree nodes in 't'.
+static long count_tree_nodes(tree t) {
+    long count = 0;
+    walk_tree_without_duplicates(&t, count_tree_nodes_r, &count);
+    return count;
+}
+
+// a client item of -ftime-report for its lifetime, shown as "<name>" in the report. free without -ftime-report.
+struct plugin_timevar {
+    plugin_timevar(const char *name) {
+        if (g_timer != NULL) {
+            g_timer->push_client_item(name);
+        }
+    }
+
+    ~plugin_timevar() {
+        if (g_timer != NULL) {
+            g_timer->pop_client_item();
+        }
+    }
+};
+
+// the functions asserts call when they fail. __assert_fail is always there, more are added by
+// "fail-fn=<name>[:<layout>[:<pass>]]" plugin arguments. the layout has a letter per argument of the function: 'e'
+// marks the text of the expression (used by soft mode), other letters are ignored. 'pass' is a function the macro
+// calls when the assert holds, instead of an empty arm. the call is kept.
+// for example Check's ck_assert_msg(expr, ...), which expands to
+//   (expr) ? _mark_point(__FILE__, __LINE__) : _ck_assert_failed(__FILE__, __LINE__, "Assertion '"#expr"' failed", ...)
+// is "fail-fn=_ck_assert_failed:fle:_mark_point". the report shows the condition and its values, and the site of
+// the assert itself, not the file & line arguments. the message and its arguments are only shown by
+// _ck_assert_failed, so not in soft mode, where the call is dropped and "Assertion 'expr' failed" is logged.
+struct fail_fn {
+    const char *name;
+    const char *layout;
+    const char *pass;
+    // the identifiers of 'name' and 'pass', once the TU has used them.
+    tree id;
+    tree pass_id;
+};
+
+static auto_vec<fail_fn> fail_fns;
+// decls found to be fail functions, by decl. there may be more than one per function: the C++ frontend has one
+// per declaration in some cases, and we don't use the lookup functions of either frontend.
+static hash_map<tree, unsigned int> fail_fn_decls;
+
+static void add_fail_fn(const char *name, const char *layout, const char *pass) {
+    fail_fn fn = { name, layout, pass, NULL_TREE, NULL_TREE };
+    fail_fns.safe_push(fn);
+}
+
+// looks up the identifiers of the fail functions, the ones the TU hasn't used yet don't exist. returns whether
+// there are any, i.e. whether there can be calls to them.
+static bool resolve_fail_fns(void) {
+    bool any = false;
+
+    unsigned int i;
+    fail_fn *fn;
+    FOR_EACH_VEC_ELT(fail_fns, i, fn) {
+        if (fn->id == NULL_TREE) {
+            fn->id = maybe_get_identifier(fn->name);
+        }
+        if (fn->pass_id == NULL_TREE && fn->pass != NULL) {
+            fn->pass_id = maybe_get_identifier(fn->pass);
+        }
+        any |= fn->id != NULL_TREE;
+    }
+
+    return any;
+}
+
+static bool is_file_scope(tree fndecl) {
+    return DECL_CONTEXT(fndecl) == NULL_TREE || TREE_CODE(DECL_CONTEXT(fndecl)) == TRANSLATION_UNIT_DECL;
+}
+
+// the index of the fail function declared by 'fndecl', or -1. a fail function is a function at file scope (extern
+// "C" in C++), matched by name.
+static int find_fail_fn(tree fndecl) {
+    unsigned int *i = fail_fn_decls.get(fndecl);
+    if (i != NULL) {
+        return *i;
+    }
+    if (DECL_NAME(fndecl) == NULL_TREE || !is_file_scope(fndecl)) {
+        return -1;
+    }
+
+    unsigned int j;
+    fail_fn *fn;
+    FOR_EACH_VEC_ELT(fail_fns, j, fn) {
+        if (fn->id != NULL_TREE && fn->id == DECL_NAME(fndecl)) {
+            fail_fn_decls.put(fndecl, j);
+            return j;
+        }
+    }
+    return -1;
+}
+
+// if 'call' is a call to a fail function, returns it.
+static const fail_fn *get_fail_fn(tree call) {
+    if (call == NULL_TREE || TREE_CODE(call) != CALL_EXPR || TREE_CODE(CALL_EXPR_FN(call)) != ADDR_EXPR ||
+        TREE_CODE(TREE_OPERAND(CALL_EXPR_FN(call), 0)) != FUNCTION_DECL) {
+        return NULL;
+    }
+
+    int i = find_fail_fn(TREE_OPERAND(CALL_EXPR_FN(call), 0));
+    return i >= 0 ? &fail_fns[i] : NULL;
+}
+
 // convert the type of 'expr' to text representing its operation, for example "+" for PLUS_EXPR.
 // this list is shortened for brevity.
 static const char *get_expr_op_repr(tree expr) {
@@ -26,41 +232,353 @@ static const char *get_expr_op_repr(tree expr) {
     case MINUS_EXPR: op = "-"; break;
     case MULT_EXPR: op = "*"; break;
     case TRUNC_DIV_EXPR: op = "/"; break;
+    case LT_EXPR: op = "<"; break;
+    case LE_EXPR: op = "<="; break;
+    case GT_EXPR: op = ">"; break;
+    case GE_EXPR: op = ">="; break;
     default: op = NULL; break;
     }
 
     return op;
 }
 
-// builds a COND_EXPR
-static inline tree _build_conditional_expr(location_t colon_loc, tree ifexp,
-    tree op1, tree op1_original_type, tree op2, tree op2_original_type) {
+// the string literals we generate, by contents: the same fragments ("(", " == ", ") || (", file names...) repeat
+// at every site, so each is built once per TU and shared. 'literal_pool_roots' keeps the trees alive across
+// garbage collections (see plugin_root_tab), the hash_map isn't seen by the GC.
+static hash_map<nofree_string_hash, tree> *literal_pool;
+static tree literal_pool_roots;
+static unsigned int literal_pool_count;
+static unsigned int literal_pool_hits;
 
-#if GCCPLUGIN_VERSION >= 8001 // a32c8316ff282ec
-    return build_conditional_expr(colon_loc, ifexp, false, op1, op1_original_type,
-        colon_loc, op2, op2_original_type, colon_loc);
-#else
-    return build_conditional_expr(colon_loc, ifexp, false, op1, op1_original_type,
-        op2, op2_original_type);
-#endif
+// returns a "const char *" pointing to a literal of 'str'.
+static tree get_string_literal(const char *str) {
+    if (literal_pool == NULL) {
+        literal_pool = new hash_map<nofree_string_hash, tree>();
+    }
+
+    tree *pooled = literal_pool->get(str);
+    if (pooled != NULL) {
+        literal_pool_hits++;
+        // the STRING_CST is shared, the expression taking its address is not.
+        return unshare_expr(*pooled);
+    }
+
+    tree literal = build_string_literal(strlen(str) + 1, str);
+    literal_pool->put((const char *)obstack_copy0(&tu_obstack, str, strlen(str)), literal);
+    literal_pool_roots = tree_cons(NULL_TREE, literal, literal_pool_roots);
+    literal_pool_count++;
+    stats.literal_bytes += strlen(str) + 1;
+    return unshare_expr(literal);
 }
 
 static tree printf_decl;
 
+// the most arguments make_output is given.
+#define MAX_OUTPUT_ARGS 2
+
 // builds a printf(format, ...) call with given args
-static tree make_printf(const char *format, vec<tree, va_gc> *args) {
-    tree fmt = build_string_literal(strlen(format) + 1, format);
-    if (args) {
-        vec_safe_insert(args, 0, fmt);
-        tree call = build_call_expr_loc_vec(UNKNOWN_LOCATION, printf_decl, args);
-        vec_free(args);
-        return call;
+static tree make_printf(const char *format, unsigned int nargs, const tree *args) {
+    tree call_args[1 + MAX_OUTPUT_ARGS] = { get_string_literal(format) };
+    for (unsigned int i = 0; i < nargs; i++) {
+        call_args[1 + i] = args[i];
+    }
+    return build_call_expr_loc_array(UNKNOWN_LOCATION, printf_decl, 1 + nargs, call_args);
+}
+
+// for OUTPUT_WRITE: the buffer & position of the handler currently being built.
+static tree output_buf;
+static tree output_pos;
+
+static tree make_output_size(void) {
+    return build_int_cst(size_type_node, output_buffer_size);
+}
+
+// MIN(pos, sizeof(buf)) - snprintf returns the length it would have written, so pos may overrun the buffer.
+static tree make_output_offset(void) {
+    return fold_build2(MIN_EXPR, size_type_node, output_pos, make_output_size());
+}
+
+// builds pos += snprintf(buf + MIN(pos, sizeof(buf)), sizeof(buf) - MIN(pos, sizeof(buf)), format, ...)
+static tree make_buffered_printf(const char *format, unsigned int nargs, const tree *args) {
+    tree offset = make_output_offset();
+    tree buf = fold_convert(build_pointer_type(char_type_node), build_fold_addr_expr(output_buf));
+    tree call_args[3 + MAX_OUTPUT_ARGS] = {
+        fold_build_pointer_plus(buf, offset),
+        fold_build2(MINUS_EXPR, size_type_node, make_output_size(), offset),
+        get_string_literal(format),
+    };
+    for (unsigned int i = 0; i < nargs; i++) {
+        call_args[3 + i] = args[i];
+    }
+    tree call = build_call_expr_loc_array(UNKNOWN_LOCATION, builtin_decl_explicit(BUILT_IN_SNPRINTF), 3 + nargs,
+        call_args);
+
+    tree sum = fold_build2(PLUS_EXPR, size_type_node, output_pos, fold_convert(size_type_node, call));
+    return build2(MODIFY_EXPR, size_type_node, output_pos, sum);
+}
+
+// adds printf-like output of the message, in the current output mode. there are at most MAX_OUTPUT_ARGS 'args'.
+static tree make_output(const char *format, unsigned int nargs = 0, const tree *args = NULL) {
+    gcc_assert(nargs <= MAX_OUTPUT_ARGS);
+    if (output_mode == OUTPUT_WRITE) {
+        return make_buffered_printf(format, nargs, args);
+    } else {
+        return make_printf(format, nargs, args);
+    }
+}
+
+static tree write_decl;
+
+// write() isn't a builtin, and the TU may not have declared it (no unistd.h). we declare it ourselves, the
+// declaration isn't seen by the frontend.
+static tree get_write_decl(void) {
+    if (write_decl == NULL_TREE) {
+        tree fntype = build_function_type_list(signed_size_type_node, integer_type_node, const_ptr_type_node,
+            size_type_node, NULL_TREE);
+        write_decl = build_fn_decl("write", fntype);
+    }
+    return write_decl;
+}
+
+// for OUTPUT_WRITE: creates the buffer & position variables inside the handler 'fndecl'. returns the statement
+// initializing them.
+static tree make_output_vars(tree fndecl) {
+    tree buf_type = build_array_type_nelts(char_type_node, output_buffer_size);
+    output_buf = build_decl(DECL_SOURCE_LOCATION(fndecl), VAR_DECL, get_identifier("buf"), buf_type);
+    output_pos = build_decl(DECL_SOURCE_LOCATION(fndecl), VAR_DECL, get_identifier("pos"), size_type_node);
+    DECL_CONTEXT(output_buf) = fndecl;
+    DECL_CONTEXT(output_pos) = fndecl;
+    TREE_USED(output_buf) = 1;
+    TREE_USED(output_pos) = 1;
+    DECL_CHAIN(output_buf) = output_pos;
+
+    // not DECL_INITIAL, it doesn't initialize anything in a function we build this way.
+    return build2(MODIFY_EXPR, size_type_node, output_pos, build_zero_cst(size_type_node));
+}
+
+// for OUTPUT_WRITE: write(2, buf, MIN(pos, sizeof(buf)))
+static tree make_output_flush(void) {
+    tree buf = fold_convert(const_ptr_type_node, build_fold_addr_expr(output_buf));
+    return build_call_expr_loc(UNKNOWN_LOCATION, get_write_decl(), 3, build_int_cst(integer_type_node, 2),
+        buf, make_output_offset());
+}
+
+// returns the kind of value the runtime will treat a value of 'type' as, see ai_runtime.h.
+static char get_value_kind(tree type) {
+    if (POINTER_TYPE_P(type)) {
+        return 'p';
+    } else if (INTEGRAL_TYPE_P(type)) {
+        return TYPE_UNSIGNED(type) ? 'u' : 'i';
+    } else if (SCALAR_FLOAT_TYPE_P(type)) {
+        return 'f';
+    } else {
+        return 'x';
+    }
+}
+
+// for OUTPUT_PRINTF: __ai_fmt_i64 & co. (see ai_runtime.h), by value kind.
+static tree fmt_decls[4];
+
+static tree get_fmt_decl(int i, const char *name, tree type) {
+    if (fmt_decls[i] == NULL_TREE) {
+        tree fntype = build_function_type_list(void_type_node, type, NULL_TREE);
+        fmt_decls[i] = build_fn_decl(name, fntype);
+    }
+    return fmt_decls[i];
+}
+
+// adds output of a plain value, formatted according to its type. printf-ing everything with "%d" is wrong for
+// 64-bit values, pointers and doubles.
+static tree make_value_output(tree value) {
+    const char kind = get_value_kind(TREE_TYPE(value));
+
+    if (output_mode == OUTPUT_WRITE) {
+        // same formats as the runtime uses, see out_value in ai_format.c.
+        const char *format;
+        tree type;
+        switch (kind) {
+        case 'i': format = "%lld"; type = long_long_integer_type_node; break;
+        case 'u': format = "%llu"; type = long_long_unsigned_type_node; break;
+        case 'p': format = "0x%llx"; type = long_long_unsigned_type_node; break;
+        case 'f': format = "%g"; type = double_type_node; break;
+        default: return make_output("?");
+        }
+
+        tree arg = fold_convert(type, value);
+        return make_output(format, 1, &arg);
+    }
+
+    // a direct call, no varargs promotion and no format to parse at run time.
+    tree decl;
+    switch (kind) {
+    case 'i': decl = get_fmt_decl(0, "__ai_fmt_i64", long_long_integer_type_node); break;
+    case 'u': decl = get_fmt_decl(1, "__ai_fmt_u64", long_long_unsigned_type_node); break;
+    case 'p': decl = get_fmt_decl(2, "__ai_fmt_ptr", const_ptr_type_node); break;
+    case 'f': decl = get_fmt_decl(3, "__ai_fmt_f64", double_type_node); break;
+    default: return make_output("?");
+    }
+    return build_call_expr_loc(UNKNOWN_LOCATION, decl, 1,
+        fold_convert(TREE_VALUE(TYPE_ARG_TYPES(TREE_TYPE(decl))), value));
+}
+
+// the AI_CMP_* kind (see ai_runtime.h) of a memcmp/bcmp/strcmp/strncmp call, or -1. only the handlers render
+// these (by calling the runtime with the arguments of the call), the result of the call is of no interest.
+static int get_compare_kind(tree expr) {
+    if (TREE_CODE(expr) != CALL_EXPR || (output_mode != OUTPUT_PRINTF && output_mode != OUTPUT_WRITE)) {
+        return -1;
+    }
+
+    tree fndecl = get_callee_fndecl(expr);
+    if (fndecl == NULL_TREE || DECL_BUILT_IN_CLASS(fndecl) != BUILT_IN_NORMAL) {
+        return -1;
+    }
+    switch (DECL_FUNCTION_CODE(fndecl)) {
+    case BUILT_IN_MEMCMP: return 0;
+    case BUILT_IN_BCMP: return 1;
+    case BUILT_IN_STRCMP: return 2;
+    case BUILT_IN_STRNCMP: return 3;
+    default: return -1;
+    }
+}
+
+static tree fmt_cmp_decl;
+static tree format_cmp_decl;
+
+// for a memcmp & co. call: __ai_fmt_cmp(kind, a, b, n), or pos += __ai_format_cmp(buf + ..., ..., kind, a, b, n)
+// for OUTPUT_WRITE. strcmp has no 'n', the runtime ignores it.
+static tree make_compare_output(tree call) {
+    tree args[4] = {
+        build_int_cst(integer_type_node, get_compare_kind(call)),
+        fold_convert(const_ptr_type_node, CALL_EXPR_ARG(call, 0)),
+        fold_convert(const_ptr_type_node, CALL_EXPR_ARG(call, 1)),
+        call_expr_nargs(call) > 2 ? fold_convert(size_type_node, CALL_EXPR_ARG(call, 2)) : size_zero_node,
+    };
+
+    if (output_mode == OUTPUT_WRITE) {
+        if (format_cmp_decl == NULL_TREE) {
+            tree fntype = build_function_type_list(size_type_node, build_pointer_type(char_type_node),
+                size_type_node, integer_type_node, const_ptr_type_node, const_ptr_type_node, size_type_node,
+                NULL_TREE);
+            format_cmp_decl = build_fn_decl("__ai_format_cmp", fntype);
+        }
+
+        tree offset = make_output_offset();
+        tree buf = fold_convert(build_pointer_type(char_type_node), build_fold_addr_expr(output_buf));
+        tree call = build_call_expr_loc(UNKNOWN_LOCATION, format_cmp_decl, 6, fold_build_pointer_plus(buf, offset),
+            fold_build2(MINUS_EXPR, size_type_node, make_output_size(), offset), args[0], args[1], args[2], args[3]);
+        return build2(MODIFY_EXPR, size_type_node, output_pos, fold_build2(PLUS_EXPR, size_type_node, output_pos, call));
+    }
+
+    if (fmt_cmp_decl == NULL_TREE) {
+        tree fntype = build_function_type_list(void_type_node, integer_type_node, const_ptr_type_node,
+            const_ptr_type_node, size_type_node, NULL_TREE);
+        fmt_cmp_decl = build_fn_decl("__ai_fmt_cmp", fntype);
+    }
+    return build_call_expr_loc(UNKNOWN_LOCATION, fmt_cmp_decl, 4, args[0], args[1], args[2], args[3]);
+}
+
+// the truth values of the sub-conditions of an assert, recorded while its condition is evaluated, so the failure
+// path knows which side of each &&/|| failed without testing it again. each operand of the &&/|| nodes at the top
+// of the condition (not those under other operators, which are tested again) gets a slot, numbered in pre-order:
+// for each node, its left operand, the slots of the left side, its right operand, then the slots of the right side.
+// slot k is bits 2k (set if the operand was evaluated) and 2k + 1 (its value) of an unsigned long long.
+#define MAX_TRUTH_SLOTS 32
+
+struct truth_mask {
+    // the local variable of the assert, or the parameter of its handler.
+    tree var;
+    unsigned int next_slot;
+};
+
+static bool is_truth_expr(tree expr) {
+    const enum tree_code code = TREE_CODE(expr);
+    return code == TRUTH_ANDIF_EXPR || code == TRUTH_AND_EXPR || code == TRUTH_ORIF_EXPR || code == TRUTH_OR_EXPR;
+}
+
+// the number of slots the condition 'expr' needs.
+static unsigned int count_truth_slots(tree expr) {
+    if (!is_truth_expr(expr)) {
+        return 0;
+    }
+    return 2 + count_truth_slots(TREE_OPERAND(expr, 0)) + count_truth_slots(TREE_OPERAND(expr, 1));
+}
+
+// the recorded value of 'slot', as an unsigned long long 0 or 1.
+static tree make_truth_slot_value(const truth_mask *mask, unsigned int slot) {
+    tree ull = long_long_unsigned_type_node;
+    tree shifted = fold_build2(RSHIFT_EXPR, ull, mask->var, build_int_cst(unsigned_type_node, 2 * slot + 1));
+    return fold_build2(BIT_AND_EXPR, ull, shifted, build_int_cst(ull, 1));
+}
+
+static tree make_truth_slot_test(const truth_mask *mask, unsigned int slot) {
+    return fold_build2(NE_EXPR, boolean_type_node, make_truth_slot_value(mask, slot),
+        build_zero_cst(long_long_unsigned_type_node));
+}
+
+static tree make_conditional_expr_repr(tree expr, truth_mask *mask = NULL, int slot = -1);
+
+// literal text of the message is collected in an obstack until a value has to be printed, so each run of text
+// is output by a single call (with a single string literal).
+static void append_literal(struct obstack *literal, const char *text) {
+    for (; *text != '\0'; text++) {
+        // it ends up as a format.
+        if (*text == '%') {
+            obstack_1grow(literal, '%');
+        }
+        obstack_1grow(literal, *text);
+    }
+}
+
+static void flush_literal(tree *stmts, struct obstack *literal) {
+    if (obstack_object_size(literal) == 0) {
+        return;
+    }
+
+    obstack_1grow(literal, '\0');
+    char *text = (char *)obstack_finish(literal);
+    append_to_statement_list(make_output(text), stmts);
+    obstack_free(literal, text);
+}
+
+// appends the output of a binary/plain expression to 'stmts'. operators and constants go into the pending literal
+// text, values are output as they come.
+static void make_plain_expr_repr(tree expr, tree *stmts, struct obstack *literal) {
+    const enum tree_code code = TREE_CODE(expr);
+    const char *op = get_expr_op_repr(expr);
+
+    if (code == TRUTH_ANDIF_EXPR || code == TRUTH_AND_EXPR || code == TRUTH_ORIF_EXPR || code == TRUTH_OR_EXPR) {
+        flush_literal(stmts, literal);
+        append_to_statement_list(make_conditional_expr_repr(expr), stmts);
+    } else if (op != NULL) {
+        // if it's a binary expression - print both sides.
+        make_plain_expr_repr(TREE_OPERAND(expr, 0), stmts, literal);
+        append_literal(literal, " ");
+        append_literal(literal, op);
+        append_literal(literal, " ");
+        make_plain_expr_repr(TREE_OPERAND(expr, 1), stmts, literal);
+    } else if (get_compare_kind(expr) >= 0) {
+        // the first difference is much more useful than the sign memcmp returned.
+        flush_literal(stmts, literal);
+        append_to_statement_list(make_compare_output(expr), stmts);
+    } else if (TREE_CODE(expr) == INTEGER_CST && INTEGRAL_TYPE_P(TREE_TYPE(expr))) {
+        // constants are known now, they become part of the text around them.
+        char buf[WIDE_INT_PRINT_BUFFER_SIZE];
+#if GCCPLUGIN_VERSION >= 8001
+        print_dec(wi::to_wide(expr), buf, TYPE_SIGN(TREE_TYPE(expr)));
+#else
+        print_dec(expr, buf, TYPE_SIGN(TREE_TYPE(expr)));
+#endif
+        append_literal(literal, buf);
     } else {
-        return build_call_expr_loc(UNKNOWN_LOCATION, printf_decl, 1, fmt);
+        // it's a plain value - print it alone.
+        flush_literal(stmts, literal);
+        append_to_statement_list(make_value_output(expr), stmts);
     }
 }
 
-static tree make_conditional_expr_repr(tree expr) {
+// with a 'mask', the &&/|| nodes test the recorded truth values instead of their operands. 'slot' is the slot of
+// 'expr' itself, -1 for the whole condition.
+static tree make_conditional_expr_repr(tree expr, truth_mask *mask, int slot) {
     const enum tree_code code = TREE_CODE(expr);
 
     // for TRUTH_ANDIF_EXPR/TRUTH_AND_EXPR:
@@ -68,131 +586,2440 @@ static tree make_conditional_expr_repr(tree expr) {
     // * if right fails, we print (...) && right
     // * if both pass, we print nothing
     if (code == TRUTH_ANDIF_EXPR || code == TRUTH_AND_EXPR) {
+        const int left_slot = mask != NULL ? (int)mask->next_slot++ : -1;
         tree stmts = alloc_stmt_list();
         // statements that print the left side
-        append_to_statement_list(make_conditional_expr_repr(TREE_OPERAND(expr, 0)), &stmts);
+        append_to_statement_list(make_conditional_expr_repr(TREE_OPERAND(expr, 0), mask, left_slot), &stmts);
 
         tree left_stmts = stmts;
 
+        const int right_slot = mask != NULL ? (int)mask->next_slot++ : -1;
         stmts = alloc_stmt_list();
         // statements that print the right side
-        append_to_statement_list(make_printf("(...) && (", NULL), &stmts);
-        append_to_statement_list(make_conditional_expr_repr(TREE_OPERAND(expr, 1)), &stmts);
-        append_to_statement_list(make_printf(")", NULL), &stmts);
+        append_to_statement_list(make_output("(...) && ("), &stmts);
+        append_to_statement_list(make_conditional_expr_repr(TREE_OPERAND(expr, 1), mask, right_slot), &stmts);
+        append_to_statement_list(make_output(")"), &stmts);
 
         tree right_stmts = stmts;
 
         // if "left" condition passes, run "right" statements. else run "left" statements.
-        tree cond = _build_conditional_expr(UNKNOWN_LOCATION, TREE_OPERAND(expr, 0),
-            right_stmts, NULL_TREE,
-            left_stmts, NULL_TREE);
-
-        return cond;
+        tree left = mask != NULL ? make_truth_slot_test(mask, left_slot) : TREE_OPERAND(expr, 0);
+        return build3(COND_EXPR, void_type_node, left, right_stmts, left_stmts);
     }
     // for TRUTH_ORIF_EXPR/TRUTH_OR_EXPR
     // * if left and right fail, we print both
     // * if any pass, we print nothing
     else if (code == TRUTH_ORIF_EXPR || code == TRUTH_OR_EXPR) {
         tree stmts = alloc_stmt_list();
-        append_to_statement_list(make_printf("(", NULL), &stmts);
-        append_to_statement_list(make_conditional_expr_repr(TREE_OPERAND(expr, 0)), &stmts);
-        append_to_statement_list(make_printf(") || (", NULL), &stmts);
-        append_to_statement_list(make_conditional_expr_repr(TREE_OPERAND(expr, 1)), &stmts);
-        append_to_statement_list(make_printf(")", NULL), &stmts);
+        append_to_statement_list(make_output("("), &stmts);
+        const int left_slot = mask != NULL ? (int)mask->next_slot++ : -1;
+        append_to_statement_list(make_conditional_expr_repr(TREE_OPERAND(expr, 0), mask, left_slot), &stmts);
+        append_to_statement_list(make_output(") || ("), &stmts);
+        const int right_slot = mask != NULL ? (int)mask->next_slot++ : -1;
+        append_to_statement_list(make_conditional_expr_repr(TREE_OPERAND(expr, 1), mask, right_slot), &stmts);
+        append_to_statement_list(make_output(")"), &stmts);
 
+        if (mask != NULL && slot < 0) {
+            // the whole condition, which has failed.
+            return stmts;
+        }
         // if expr passes - print nothing (build_empty_stmt branch).
         // if expr fails - print both
-        return _build_conditional_expr(UNKNOWN_LOCATION, expr,
-            build_empty_stmt(UNKNOWN_LOCATION), NULL_TREE,
-            stmts, NULL_TREE);
+        tree cond = mask != NULL ? make_truth_slot_test(mask, slot) : expr;
+        return build3(COND_EXPR, void_type_node, cond, build_empty_stmt(UNKNOWN_LOCATION), stmts);
     }
     // for others - we always print them - because this code gets called only if the expression it reprs
     // has failed, because the &&/|| code guards it.
     else {
         tree stmts = alloc_stmt_list();
 
-        const char *op = get_expr_op_repr(expr);
-        // if it's a binary expression - print both sides.
-        if (op != NULL) {
-            char format[64];
-            (void)snprintf(format, sizeof(format), " %s ", op);
-
-            append_to_statement_list(make_conditional_expr_repr(TREE_OPERAND(expr, 0)), &stmts);
-            append_to_statement_list(make_printf(format, NULL), &stmts);
-            append_to_statement_list(make_conditional_expr_repr(TREE_OPERAND(expr, 1)), &stmts);
-        } else {
-            // it's a plain value - print it alone.
-            vec<tree, va_gc> *args;
-            vec_alloc(args, 2); // 1 for the format
-            args->quick_push(expr);
-
-            append_to_statement_list(make_printf("%d", args), &stmts);
-        }
+        // flushed before any nested &&/||, so there's only one growing object at a time.
+        make_plain_expr_repr(expr, &stmts, &function_obstack);
+        flush_literal(&stmts, &function_obstack);
 
         return stmts;
     }
 }
 
-static void patch_assert(tree cond_expr) {
-    printf_decl = lookup_name(get_identifier("printf"));
-    COND_EXPR_ELSE(cond_expr) = make_conditional_expr_repr(COND_EXPR_COND(cond_expr));
+static tree find_call_r(tree *tp, int *walk_subtrees, void *data) {
+    return TREE_CODE(*tp) == CALL_EXPR ? *tp : NULL_TREE;
 }
 
-static bool is_assert_fail_cond_expr(tree expr) {
-    if (TREE_CODE(expr) != COND_EXPR) {
+// whether a leaf has to be captured in a SAVE_EXPR, or can simply be evaluated again on the failure path.
+// evaluating it again is fine if it's cheap and pure, and won't trap: leaves behind a false && side aren't
+// evaluated by the condition, but are still passed to the handler (or the runtime).
+static bool leaf_needs_save_expr(tree leaf, bool cond_has_side_effects) {
+    if (CONSTANT_CLASS_P(leaf)) {
         return false;
     }
+    // another part of the condition may change what the leaf reads.
+    if (cond_has_side_effects) {
+        return true;
+    }
 
-    tree expr_else = COND_EXPR_ELSE(expr);
     return (
-        TREE_CODE(COND_EXPR_THEN(expr)) == NOP_EXPR &&
-        TREE_CODE(expr_else) == CALL_EXPR &&
-        TREE_CODE(CALL_EXPR_FN(expr_else)) == ADDR_EXPR &&
-        TREE_CODE(TREE_OPERAND(CALL_EXPR_FN(expr_else), 0)) == FUNCTION_DECL &&
-        // IDENTIFIER_POINTER(DECL_NAME(...)) gets the (null-terminated) name string from a declaration.
-        0 == strcmp("__assert_fail", IDENTIFIER_POINTER(DECL_NAME(TREE_OPERAND(CALL_EXPR_FN(expr_else), 0))))
+        TREE_SIDE_EFFECTS(leaf) ||
+        generic_expr_could_trap_p(leaf) ||
+        // even pure calls aren't cheap.
+        walk_tree_without_duplicates(&leaf, find_call_r, NULL) != NULL_TREE
     );
 }
 
-static void iterate_function_body(tree expr) {
-    tree body;
-
-    if (TREE_CODE(expr) == BIND_EXPR) {
-        body = BIND_EXPR_BODY(expr);
+// wraps the "leaves" of the condition - the values we're going to print - in SAVE_EXPRs where needed, and collects
+// them in left-to-right order, which is also the order in which make_conditional_expr_repr prints them.
+// after this, the leaves can be referenced again (on the failure path) without being re-evaluated, unless they're
+// cheap enough - a SAVE_EXPR forces a temporary on the passing path as well, which is what we're trying to avoid.
+static void wrap_leaves_in_save_expr(tree *expr, vec<tree> &leaves, bool cond_has_side_effects) {
+    if (get_expr_op_repr(*expr) != NULL) {
+        wrap_leaves_in_save_expr(&TREE_OPERAND(*expr, 0), leaves, cond_has_side_effects);
+        wrap_leaves_in_save_expr(&TREE_OPERAND(*expr, 1), leaves, cond_has_side_effects);
+    } else if (get_compare_kind(*expr) >= 0) {
+        // the handler gets the arguments instead of the result. the call stays as it is, so the passing path
+        // doesn't change (unless an argument needs a SAVE_EXPR).
+        for (int i = 0; i < call_expr_nargs(*expr); i++) {
+            wrap_leaves_in_save_expr(&CALL_EXPR_ARG(*expr, i), leaves, cond_has_side_effects);
+        }
+    } else if (TREE_CODE(*expr) == INTEGER_CST) {
+        // handlers print these as text, see make_plain_expr_repr. nothing to pass.
+    } else if (leaf_needs_save_expr(*expr, cond_has_side_effects)) {
+        *expr = save_expr(*expr);
+        leaves.safe_push(*expr);
     } else {
-        gcc_assert(TREE_CODE(expr) == STATEMENT_LIST);
-        body = expr;
+        leaves.safe_push(unshare_expr(*expr));
+    }
+}
+
+// rebuilds the condition, with each leaf (but constants) replaced by the next PARM_DECL from 'parm'.
+// this is the condition as seen from inside the handler.
+static tree substitute_leaves(tree expr, tree *parm) {
+    if (get_expr_op_repr(expr) != NULL) {
+        tree left = substitute_leaves(TREE_OPERAND(expr, 0), parm);
+        tree right = substitute_leaves(TREE_OPERAND(expr, 1), parm);
+        return build2(TREE_CODE(expr), TREE_TYPE(expr), left, right);
+    } else if (get_compare_kind(expr) >= 0) {
+        // never called, only passed to the runtime, see make_compare_output.
+        tree call = copy_node(expr);
+        for (int i = 0; i < call_expr_nargs(call); i++) {
+            CALL_EXPR_ARG(call, i) = substitute_leaves(CALL_EXPR_ARG(call, i), parm);
+        }
+        return call;
+    } else if (TREE_CODE(expr) == INTEGER_CST) {
+        return expr;
     }
 
-    if (TREE_CODE(body) == STATEMENT_LIST) {
-        for (tree_stmt_iterator i = tsi_start(body); !tsi_end_p(i); tsi_next(&i)) {
-            tree stmt = tsi_stmt(i);
+    tree p = *parm;
+    *parm = DECL_CHAIN(p);
+    return p;
+}
 
-            if (TREE_CODE(stmt) == BIND_EXPR) {
-                iterate_function_body(stmt);
-            }
+// the handlers & soft mode counters we've created. a block using one of them is on a failure path, see
+// assert_cold_pass.
+static hash_set<tree> failure_decls;
+
+// creates the decl of a static function 'name' taking one parameter per leaf. it will hold the reporting code of
+// a single assert, so the assert itself is left with the condition and a single call. 'fail_fn' is the function
+// the handler calls in the end, if any.
+// if 'comdat', the handler is a hidden COMDAT function instead, so the linker keeps a single copy of it from all TUs.
+static tree build_handler_decl(location_t loc, const vec<tree> &leaves, tree fail_fn, const char *name, bool comdat) {
+    auto_vec<tree> arg_types(leaves.length());
+    unsigned int i;
+    tree leaf;
+    FOR_EACH_VEC_ELT(leaves, i, leaf) {
+        arg_types.quick_push(TYPE_MAIN_VARIANT(TREE_TYPE(leaf)));
+    }
+
+    tree fntype = build_function_type_array(void_type_node, arg_types.length(), arg_types.address());
+    tree fndecl = build_fn_decl(name, fntype);
+    DECL_SOURCE_LOCATION(fndecl) = loc;
+    // build_fn_decl gives us an extern declaration, make it a local definition instead.
+    DECL_EXTERNAL(fndecl) = 0;
+    TREE_PUBLIC(fndecl) = 0;
+    TREE_STATIC(fndecl) = 1;
+    TREE_USED(fndecl) = 1;
+    if (comdat) {
+        TREE_PUBLIC(fndecl) = 1;
+        DECL_VISIBILITY(fndecl) = VISIBILITY_HIDDEN;
+        DECL_VISIBILITY_SPECIFIED(fndecl) = 1;
+        make_decl_one_only(fndecl, DECL_ASSEMBLER_NAME(fndecl));
+    }
+    failure_decls.add(fndecl);
+    // if the original fail function doesn't return (__assert_fail doesn't), neither do we.
+    TREE_THIS_VOLATILE(fndecl) = fail_fn != NULL_TREE && TREE_THIS_VOLATILE(fail_fn);
+
+    // cold makes GCC predict the call as unlikely and place the handler in .text.unlikely; noinline keeps it
+    // from being inlined right back into the caller.
+    tree attrs = tree_cons(get_identifier("cold"), NULL_TREE, tree_cons(get_identifier("noinline"), NULL_TREE, NULL_TREE));
+    decl_attributes(&fndecl, attrs, 0);
+
+    tree result = build_decl(loc, RESULT_DECL, NULL_TREE, void_type_node);
+    DECL_ARTIFICIAL(result) = 1;
+    DECL_IGNORED_P(result) = 1;
+    DECL_CONTEXT(result) = fndecl;
+    DECL_RESULT(fndecl) = result;
+
+    // build the PARM_DECLs backwards so we can chain them as we go.
+    tree parms = NULL_TREE;
+    for (i = arg_types.length(); i-- > 0; ) {
+        char parm_name[16];
+        (void)snprintf(parm_name, sizeof(parm_name), "v%u", i);
+
+        tree parm = build_decl(loc, PARM_DECL, get_identifier(parm_name), arg_types[i]);
+        DECL_ARG_TYPE(parm) = arg_types[i];
+        DECL_CONTEXT(parm) = fndecl;
+        TREE_USED(parm) = 1;
+        DECL_CHAIN(parm) = parms;
+        parms = parm;
+    }
+    DECL_ARGUMENTS(fndecl) = parms;
+
+    return fndecl;
+}
+
+// sets the body of a handler created by build_handler_decl and passes it on to the middle end.
+// 'vars' are the local variables used by the body, chained.
+static void finish_handler(tree fndecl, tree vars, tree body) {
+    tree block = make_node(BLOCK);
+    BLOCK_SUPERCONTEXT(block) = fndecl;
+    BLOCK_VARS(block) = vars;
+    DECL_INITIAL(fndecl) = block;
+
+    tree bind = build3(BIND_EXPR, void_type_node, vars, body, block);
+    TREE_SIDE_EFFECTS(bind) = 1;
+    DECL_SAVED_TREE(fndecl) = bind;
+    if (print_stats) {
+        stats.tree_nodes += count_tree_nodes(bind);
+    }
+
+    // we're called in the middle of processing the function containing the assert, so we must restore it
+    // as the current function after allocating the new one.
+    push_struct_function(fndecl);
+    pop_cfun();
+
+    // no_collect - some of the trees we're still working on aren't reachable by the GC yet.
+    cgraph_node::finalize_function(fndecl, true);
+}
+
+// converts 'value' to the unsigned long long the runtime receives it as.
+static tree make_runtime_value(tree value) {
+    tree ull = long_long_unsigned_type_node;
+
+    switch (get_value_kind(TREE_TYPE(value))) {
+    case 'i': return fold_convert(ull, fold_convert(long_long_integer_type_node, value));
+    case 'u':
+    case 'p': return fold_convert(ull, value);
+    // by bits, not by value.
+    case 'f': return fold_build1(VIEW_CONVERT_EXPR, ull, fold_convert(double_type_node, value));
+    default: return build_zero_cst(ull);
+    }
+}
+
+// the truth value of 'expr', for the runtime.
+static tree make_runtime_truth_value(tree expr) {
+    tree truth = fold_build2(NE_EXPR, integer_type_node, expr, build_zero_cst(TREE_TYPE(expr)));
+    return fold_convert(long_long_unsigned_type_node, truth);
+}
+
+static void append_str(auto_vec<char> &prog, const char *str) {
+    for (; *str != '\0'; str++) {
+        prog.safe_push(*str);
+    }
+}
+
+static void push_runtime_value(vec<constructor_elt, va_gc> *&values, tree value) {
+    CONSTRUCTOR_APPEND_ELT(values, size_int(vec_safe_length(values)), value);
+}
+
+// the runtime equivalent of make_conditional_expr_repr: appends the program describing 'expr' to 'prog', and
+// the values it consumes to 'values'. the encoding is described in ai_runtime.h. 'mask' & 'slot' are as there.
+static void make_descriptor_repr(tree expr, auto_vec<char> &prog, vec<constructor_elt, va_gc> *&values,
+    truth_mask *mask = NULL, int slot = -1) {
+    const enum tree_code code = TREE_CODE(expr);
+
+    if (is_truth_expr(expr)) {
+        const bool is_and = code == TRUTH_ANDIF_EXPR || code == TRUTH_AND_EXPR;
+        const int left_slot = mask != NULL ? (int)mask->next_slot++ : -1;
+
+        prog.safe_push(is_and ? '&' : '|');
+        // the runtime doesn't evaluate anything, so it gets the same truth values make_conditional_expr_repr
+        // tests: of the left side for &&, of the whole expression for ||.
+        tree truth;
+        if (mask == NULL) {
+            truth = make_runtime_truth_value(is_and ? TREE_OPERAND(expr, 0) : expr);
+        } else if (is_and) {
+            truth = make_truth_slot_value(mask, left_slot);
+        } else {
+            truth = slot < 0 ? build_zero_cst(long_long_unsigned_type_node) : make_truth_slot_value(mask, slot);
+        }
+        push_runtime_value(values, truth);
+        make_descriptor_repr(TREE_OPERAND(expr, 0), prog, values, mask, left_slot);
+        const int right_slot = mask != NULL ? (int)mask->next_slot++ : -1;
+        make_descriptor_repr(TREE_OPERAND(expr, 1), prog, values, mask, right_slot);
+    } else {
+        const char *op = get_expr_op_repr(expr);
+        if (op != NULL) {
+            prog.safe_push('b');
+            append_str(prog, op);
+            prog.safe_push(' ');
+            make_descriptor_repr(TREE_OPERAND(expr, 0), prog, values);
+            make_descriptor_repr(TREE_OPERAND(expr, 1), prog, values);
+        } else {
+            prog.safe_push('v');
+            prog.safe_push(get_value_kind(TREE_TYPE(expr)));
+            push_runtime_value(values, make_runtime_value(expr));
         }
+    }
+}
+
+// builds the descriptor of an assert (its location and program, see ai_runtime.h) into 'prog', and the values
+// its program consumes into 'values'.
+// 'index' is the index of the array element the assert checks, if any (see take_assert_index).
+static void make_descriptor(location_t loc, tree cond, tree mask_var, tree index, auto_vec<char> &prog,
+    vec<constructor_elt, va_gc> *&values) {
+    const expanded_location xloc = expand_location(loc);
+    char header[32];
+    (void)snprintf(header, sizeof(header), ":%d\t", xloc.line);
+
+    append_str(prog, xloc.file != NULL ? xloc.file : "?");
+    append_str(prog, header);
+
+    if (index != NULL_TREE) {
+        prog.safe_push('@');
+        prog.safe_push(get_value_kind(TREE_TYPE(index)));
+        push_runtime_value(values, make_runtime_value(index));
+    }
+    truth_mask mask = { mask_var, 0 };
+    make_descriptor_repr(cond, prog, values, mask_var != NULL_TREE ? &mask : NULL);
+    prog.safe_push('\0');
+}
+
+static tree get_values_ptr_type(void) {
+    return build_pointer_type(build_qualified_type(long_long_unsigned_type_node, TYPE_QUAL_CONST));
+}
+
+// wraps 'call' (which gets the address of the values) in { unsigned long long values[] = { ... }; call; }
+// returns the BIND_EXPR. '*values_ptr' is set to the address to pass to the call before building it.
+static tree make_values_array(location_t loc, vec<constructor_elt, va_gc> *values, tree *values_ptr) {
+    tree values_type = build_array_type_nelts(long_long_unsigned_type_node, vec_safe_length(values));
+    tree values_var = build_decl(loc, VAR_DECL, get_identifier("__ai_values"), values_type);
+    DECL_CONTEXT(values_var) = current_function_decl;
+    DECL_ARTIFICIAL(values_var) = 1;
+    TREE_USED(values_var) = 1;
+    TREE_ADDRESSABLE(values_var) = 1;
+
+    tree stmts = alloc_stmt_list();
+    append_to_statement_list(build2(MODIFY_EXPR, values_type, values_var, build_constructor(values_type, values)),
+        &stmts);
+    *values_ptr = fold_convert(get_values_ptr_type(), build_fold_addr_expr(values_var));
+
+    return build3(BIND_EXPR, void_type_node, values_var, stmts, NULL_TREE);
+}
+
+static tree ai_report_decl;
+
+// builds { unsigned long long values[] = { ... }; __ai_report("<descriptor>", values); }
+// the descriptor is a string literal, so it's placed in .rodata along with all other constant strings.
+static tree make_descriptor_report(location_t loc, tree cond, tree mask, tree index) {
+    if (ai_report_decl == NULL_TREE) {
+        tree fntype = build_function_type_list(void_type_node, const_string_type_node, get_values_ptr_type(),
+            NULL_TREE);
+        ai_report_decl = build_fn_decl("__ai_report", fntype);
+    }
+
+    auto_vec<char> prog;
+    vec<constructor_elt, va_gc> *values = NULL;
+    make_descriptor(loc, cond, mask, index, prog, values);
+
+    tree values_ptr;
+    tree bind = make_values_array(loc, values, &values_ptr);
+    tree desc = get_string_literal(prog.address());
+    append_to_statement_list(build_call_expr_loc(loc, ai_report_decl, 2, desc, values_ptr), &BIND_EXPR_BODY(bind));
+
+    return bind;
+}
+
+// the lines of the sites file (OUTPUT_BINLOG), written when compilation finishes.
+static auto_vec<char *> site_lines;
+// path of the sites file, set by the "sites-file" plugin argument. defaults to <source>.ai-sites.
+static const char *sites_file;
+
+// FNV-1a. site IDs are a hash of the descriptor, so they're stable across builds, and identical for asserts
+// that'd be rendered identically anyway.
+static unsigned long long hash_descriptor(const char *desc) {
+    unsigned long long h = 0xcbf29ce484222325ULL;
+
+    for (; *desc != '\0'; desc++) {
+        h ^= (unsigned char)*desc;
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+static tree ai_log_decl;
+
+// builds { unsigned long long values[] = { ... }; __ai_log(<site id>, values, <number of values>); }
+// the descriptor itself doesn't go into the binary, only into the sites file, for ai_decode.
+static tree make_binlog_report(location_t loc, tree cond, tree mask, tree index) {
+    if (ai_log_decl == NULL_TREE) {
+        tree fntype = build_function_type_list(void_type_node, long_long_unsigned_type_node, get_values_ptr_type(),
+            unsigned_type_node, NULL_TREE);
+        ai_log_decl = build_fn_decl("__ai_log", fntype);
+    }
+
+    auto_vec<char> prog;
+    vec<constructor_elt, va_gc> *values = NULL;
+    make_descriptor(loc, cond, mask, index, prog, values);
+
+    const unsigned long long site = hash_descriptor(prog.address());
+    site_lines.safe_push(xasprintf("%016llx\t%s\n", site, prog.address()));
+
+    tree values_ptr;
+    const unsigned int nvalues = vec_safe_length(values);
+    tree bind = make_values_array(loc, values, &values_ptr);
+    tree call = build_call_expr_loc(loc, ai_log_decl, 3, build_int_cst(long_long_unsigned_type_node, site),
+        values_ptr, build_int_cst(unsigned_type_node, nvalues));
+    append_to_statement_list(call, &BIND_EXPR_BODY(bind));
+
+    return bind;
+}
+
+// writes 'lines' to 'path', and frees them.
+static void write_lines_file(const char *path, auto_vec<char *> &lines) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        error("can't write %qs: %m", path);
     } else {
-        if (is_assert_fail_cond_expr(body)) {
-            gcc_assert(TREE_CODE(expr) == BIND_EXPR);
-            gcc_assert(TREE_CODE(body) == COND_EXPR);
+        unsigned int i;
+        char *line;
+        FOR_EACH_VEC_ELT(lines, i, line) {
+            fputs(line, f);
+            free(line);
+        }
+        fclose(f);
+    }
+
+    lines.release();
+}
+
+static void write_sites_file(void) {
+    char *path = sites_file != NULL ? xstrdup(sites_file) : concat(main_input_filename, ".ai-sites", NULL);
+    write_lines_file(path, site_lines);
+    free(path);
+}
 
-            patch_assert(body);
+// writes 'str' as a JSON string.
+static void write_json_string(FILE *f, const char *str) {
+    fputc('"', f);
+    for (; *str != '\0'; str++) {
+        if (*str == '"' || *str == '\\') {
+            fprintf(f, "\\%c", *str);
+        } else if ((unsigned char)*str < 0x20) {
+            fprintf(f, "\\u%04x", *str);
+        } else {
+            fputc(*str, f);
         }
     }
+    fputc('"', f);
 }
 
-static void pre_genericize_callback(void *event_data, void *user_data) {
-    tree t = (tree)event_data;
+// peak RSS of the compiler so far, in KB.
+static long get_peak_rss(void) {
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
 
-    if (TREE_CODE(t) == FUNCTION_DECL) {
-        iterate_function_body(DECL_SAVED_TREE(t));
+// a single line, so the files of all TUs of a build can be concatenated & processed as JSON lines.
+static void write_stats_file(void) {
+    FILE *f = fopen(stats_file, "w");
+    if (f == NULL) {
+        error("can't write %qs: %m", stats_file);
+        return;
     }
+
+    fputs("{\"file\": ", f);
+    write_json_string(f, main_input_filename);
+    fprintf(f, ", \"functions\": %u, \"asserts\": %u, \"loops\": %u, \"tree_nodes\": %ld, \"string_literals\": %u, "
+        "\"string_literal_uses\": %u, \"string_literal_bytes\": %lu, \"size_estimate\": %lu, \"peak_rss_kb\": %ld, "
+        "\"tu_obstack_bytes\": %zu, \"function_obstack_peak_bytes\": %zu}\n",
+        stats.functions, stats.asserts, stats.loops, stats.tree_nodes, literal_pool_count,
+        literal_pool_count + literal_pool_hits, stats.literal_bytes, stats.size_estimate, get_peak_rss(),
+        obstack_memory_used(&tu_obstack), stats.function_memory_peak);
+    fclose(f);
 }
 
-int plugin_init(struct plugin_name_args *plugin_info, struct plugin_gcc_version *version) {
-    printf("I'm loaded!, compiled for GCC %s\n", gcc_version.basever);
-    register_callback(plugin_info->base_name, PLUGIN_PRE_GENERICIZE, pre_genericize_callback, NULL);
+static void finish_callback(void *event_data, void *user_data) {
+    if (output_mode == OUTPUT_BINLOG) {
+        write_sites_file();
+    }
+
+    if (print_stats && stats_file != NULL) {
+        write_stats_file();
+    } else if (print_stats) {
+        fprintf(stderr, "%s: %u functions, %u asserts (%u in reduction loops), %ld tree nodes added, "
+            "%u string literals (%lu bytes), %u uses deduplicated, generated code of estimated size %lu insns\n",
+            main_input_filename, stats.functions, stats.asserts, stats.loops, stats.tree_nodes, literal_pool_count,
+            stats.literal_bytes, literal_pool_hits, stats.size_estimate);
+        fprintf(stderr, "%s: peak RSS %ld KB, %zu bytes of TU strings, at most %zu bytes of temporaries per function\n",
+            main_input_filename, get_peak_rss(), obstack_memory_used(&tu_obstack), stats.function_memory_peak);
+    }
+}
+
+// the function being processed.
+static tree current_fndecl;
+
+// the constant an argument of the fail call is, if it's a literal which a shared handler can use as is: a number,
+// or a string (the text of the expression, __FILE__, a message). NULL_TREE otherwise.
+static tree get_literal_arg(tree arg) {
+    STRIP_NOPS(arg);
+    if (TREE_CODE(arg) == ADDR_EXPR) {
+        arg = TREE_OPERAND(arg, 0);
+        if (TREE_CODE(arg) == ARRAY_REF && integer_zerop(TREE_OPERAND(arg, 1))) {
+            arg = TREE_OPERAND(arg, 0);
+        }
+        return TREE_CODE(arg) == STRING_CST ? arg : NULL_TREE;
+    }
+    return TREE_CODE(arg) == INTEGER_CST || TREE_CODE(arg) == REAL_CST ? arg : NULL_TREE;
+}
+
+static bool is_literal_arg(tree arg) {
+    return get_literal_arg(arg) != NULL_TREE;
+}
+
+static void append_int_cst(auto_vec<char> &sig, tree cst) {
+    char buf[WIDE_INT_PRINT_BUFFER_SIZE];
+#if GCCPLUGIN_VERSION >= 8001
+    print_dec(wi::to_wide(cst), buf, TYPE_SIGN(TREE_TYPE(cst)));
+#else
+    print_dec(cst, buf, TYPE_SIGN(TREE_TYPE(cst)));
+#endif
+    append_str(sig, buf);
+}
+
+// describes a type in a handler signature: the kind & precision of scalars, the name of the others.
+static void append_type_signature(auto_vec<char> &sig, tree type) {
+    char buf[16];
+    type = TYPE_MAIN_VARIANT(type);
+    (void)snprintf(buf, sizeof(buf), "%c%u", get_value_kind(type), (unsigned int)TYPE_PRECISION(type));
+    append_str(sig, buf);
+
+    tree name = TYPE_NAME(type);
+    if (get_value_kind(type) == 'x' && name != NULL_TREE) {
+        if (TREE_CODE(name) == TYPE_DECL) {
+            name = DECL_NAME(name);
+        }
+        if (name != NULL_TREE && TREE_CODE(name) == IDENTIFIER_NODE) {
+            append_str(sig, IDENTIFIER_POINTER(name));
+        }
+    }
+}
+
+// describes an argument of the fail call: its type, and the value of literals, which the handler has in its body.
+static void append_fail_arg_signature(auto_vec<char> &sig, tree arg) {
+    char buf[64];
+    append_type_signature(sig, TREE_TYPE(arg));
+
+    tree literal = get_literal_arg(arg);
+    if (literal == NULL_TREE) {
+        return;
+    }
+    sig.safe_push('=');
+    if (TREE_CODE(literal) == STRING_CST) {
+        (void)snprintf(buf, sizeof(buf), "%d\"", TREE_STRING_LENGTH(literal));
+        append_str(sig, buf);
+        // the signature is a C string.
+        for (int i = 0; i < TREE_STRING_LENGTH(literal); i++) {
+            const char c = TREE_STRING_POINTER(literal)[i];
+            if (c == '\0' || c == '\\') {
+                sig.safe_push('\\');
+            }
+            sig.safe_push(c == '\0' ? '0' : c);
+        }
+    } else if (TREE_CODE(literal) == INTEGER_CST) {
+        append_int_cst(sig, literal);
+    } else {
+        real_to_hexadecimal(buf, TREE_REAL_CST_PTR(literal), sizeof(buf), 0, 1);
+        append_str(sig, buf);
+    }
+}
+
+// describes the structure of the condition: operators, constants and the types of the leaves.
+static void append_handler_signature(auto_vec<char> &sig, tree expr) {
+    char buf[16];
+    const char *op = get_expr_op_repr(expr);
+
+    if (op != NULL) {
+        sig.safe_push('(');
+        append_handler_signature(sig, TREE_OPERAND(expr, 0));
+        append_str(sig, op);
+        append_handler_signature(sig, TREE_OPERAND(expr, 1));
+        sig.safe_push(')');
+    } else if (get_compare_kind(expr) >= 0) {
+        (void)snprintf(buf, sizeof(buf), "cmp%d(", get_compare_kind(expr));
+        append_str(sig, buf);
+        for (int i = 0; i < call_expr_nargs(expr); i++) {
+            append_handler_signature(sig, CALL_EXPR_ARG(expr, i));
+            sig.safe_push(',');
+        }
+        sig.safe_push(')');
+    } else if (TREE_CODE(expr) == INTEGER_CST) {
+        append_int_cst(sig, expr);
+    } else if (get_value_kind(TREE_TYPE(expr)) != 'x') {
+        // passed as the widest type of their kind, see get_handler_arg_type.
+        sig.safe_push(get_value_kind(TREE_TYPE(expr)));
+    } else {
+        (void)snprintf(buf, sizeof(buf), "x%u", (unsigned int)TYPE_PRECISION(TREE_TYPE(expr)));
+        append_str(sig, buf);
+    }
+}
+
+// the name of the handler of an assert: a hash of everything that goes into its body, including the literal
+// arguments of the fail call, and the types of the others, which become its parameters. all instances of the assert
+// get the same handler: in all TUs which include the same inline function, in all instantiations of a template
+// (if the values have the same kinds), in all functions a macro defines.
+static const char *make_handler_name(location_t loc, tree cond, tree fail_call, bool has_mask, tree index,
+    bool comdat) {
+    const expanded_location xloc = expand_location(loc);
+    char buf[64];
+    auto_vec<char> sig;
+
+    append_str(sig, xloc.file);
+    (void)snprintf(buf, sizeof(buf), ":%d:%d:%d:%lu:%d:%d:%d:", xloc.line, xloc.column, (int)output_mode,
+        output_buffer_size, fail_call != NULL_TREE, has_mask, comdat);
+    append_str(sig, buf);
+    if (index != NULL_TREE) {
+        sig.safe_push('@');
+        sig.safe_push(get_value_kind(TREE_TYPE(index)));
+    }
+    append_handler_signature(sig, cond);
+    if (fail_call != NULL_TREE) {
+        call_expr_arg_iterator iter;
+        tree arg;
+        FOR_EACH_CALL_EXPR_ARG(arg, iter, fail_call) {
+            sig.safe_push(',');
+            append_fail_arg_signature(sig, arg);
+        }
+    }
+    sig.safe_push('\0');
+
+    (void)snprintf(buf, sizeof(buf), "__assert_introspect_fail_%016llx", hash_descriptor(sig.address()));
+    return (const char *)obstack_copy0(&tu_obstack, buf, strlen(buf));
+}
+
+// handlers already built in this TU, by name.
+static hash_map<nofree_string_hash, tree> *handlers;
+static unsigned int handler_clash_count;
+
+// whether the handler 'fndecl' can be called with 'args'. the name only has the names of class types, instantiations
+// of a template with different classes of the same name (or the same class in different scopes) get the same one.
+static bool handler_takes_args_p(tree fndecl, const vec<tree> &args) {
+    tree parm_type = TYPE_ARG_TYPES(TREE_TYPE(fndecl));
+    unsigned int i;
+    tree arg;
+    FOR_EACH_VEC_ELT(args, i, arg) {
+        if (parm_type == NULL_TREE || !useless_type_conversion_p(TREE_VALUE(parm_type), TREE_TYPE(arg))) {
+            return false;
+        }
+        parm_type = TREE_CHAIN(parm_type);
+    }
+    return parm_type == NULL_TREE || VOID_TYPE_P(TREE_VALUE(parm_type));
+}
+
+// the type a value is passed to the handler as: the widest of its kind, the handler prints it as such anyway.
+// instantiations of a template with different types can then share the handler, only the conversions at the call
+// differ.
+static tree get_handler_arg_type(tree type) {
+    switch (get_value_kind(type)) {
+    case 'i': return long_long_integer_type_node;
+    case 'u': return long_long_unsigned_type_node;
+    case 'p': return const_ptr_type_node;
+    case 'f': return double_type_node;
+    default: return TYPE_MAIN_VARIANT(type);
+    }
+}
+
+// builds the handler of an assert, returns the call to it. if 'fail_call' is given, the handler ends with it.
+// the 'mask' of the assert, if any, is passed as the first parameter, followed by the 'index' of the element it checks.
+static tree make_handler_report(location_t loc, tree cond, const vec<tree> &leaves, tree fail_call, tree mask,
+    tree index) {
+    // asserts in inline functions (from headers, mostly) get their handler rewritten in every TU that uses them.
+    // make those COMDAT so only one is linked in. the same goes for the template instantiations the C++ frontend
+    // has made COMDAT.
+    bool comdat = DECL_DECLARED_INLINE_P(current_fndecl) || DECL_COMDAT(current_fndecl);
+    // all instances of a handler have to be the same, so values local to the caller which the fail call uses
+    // (__PRETTY_FUNCTION__, usually) are passed in as well.
+    auto_vec<tree> args(leaves.length() + 2);
+    unsigned int i;
+    tree arg;
+    if (mask != NULL_TREE) {
+        args.quick_push(mask);
+    }
+    if (index != NULL_TREE) {
+        args.quick_push(fold_convert(get_handler_arg_type(TREE_TYPE(index)), index));
+    }
+    FOR_EACH_VEC_ELT(leaves, i, arg) {
+        args.quick_push(fold_convert(get_handler_arg_type(TREE_TYPE(arg)), arg));
+    }
+    if (fail_call != NULL_TREE) {
+        call_expr_arg_iterator iter;
+        FOR_EACH_CALL_EXPR_ARG(arg, iter, fail_call) {
+            if (!is_literal_arg(arg)) {
+                args.safe_push(arg);
+            }
+        }
+    }
+
+    const char *name = make_handler_name(loc, cond, fail_call, mask != NULL_TREE, index, comdat);
+    if (handlers == NULL) {
+        handlers = new hash_map<nofree_string_hash, tree>();
+    }
+    tree *existing = handlers->get(name);
+    if (existing != NULL && handler_takes_args_p(*existing, args)) {
+        obstack_free(&tu_obstack, (void *)name);
+        return build_call_expr_loc_array(loc, *existing, args.length(), args.address());
+    }
+    if (existing != NULL) {
+        // a local handler of its own: other TUs may have picked either of the types for the shared one.
+        char buf[96];
+        (void)snprintf(buf, sizeof(buf), "%s_%u", name, handler_clash_count++);
+        name = (const char *)obstack_copy0(&tu_obstack, buf, strlen(buf));
+        comdat = false;
+    }
+
+    tree fndecl = build_handler_decl(loc, args, fail_call != NULL_TREE ? get_callee_fndecl(fail_call) : NULL_TREE,
+        name, comdat);
+    handlers->put(name, fndecl);
+
+    tree parm = DECL_ARGUMENTS(fndecl);
+    tree vars = NULL_TREE;
+    tree body = alloc_stmt_list();
+    if (output_mode == OUTPUT_WRITE) {
+        append_to_statement_list(make_output_vars(fndecl), &body);
+        vars = output_buf;
+    }
+    if (fail_call == NULL_TREE) {
+        // nobody's going to print the location for us.
+        const expanded_location xloc = expand_location(loc);
+        tree loc_args[] = { get_string_literal(xloc.file), build_int_cst(integer_type_node, xloc.line) };
+        append_to_statement_list(make_output("%s:%d: ", ARRAY_SIZE(loc_args), loc_args), &body);
+    }
+    truth_mask handler_mask = { parm, 0 };
+    if (mask != NULL_TREE) {
+        parm = DECL_CHAIN(parm);
+    }
+    if (index != NULL_TREE) {
+        append_to_statement_list(make_output("at index "), &body);
+        append_to_statement_list(make_value_output(parm), &body);
+        append_to_statement_list(make_output(": "), &body);
+        parm = DECL_CHAIN(parm);
+    }
+    tree handler_cond = substitute_leaves(cond, &parm);
+    append_to_statement_list(make_conditional_expr_repr(handler_cond, mask != NULL_TREE ? &handler_mask : NULL),
+        &body);
+    append_to_statement_list(make_output("\n"), &body);
+    if (fail_call != NULL_TREE) {
+        // the rest of the parameters replace the non-literal arguments of the fail call.
+        fail_call = copy_node(fail_call);
+        for (i = 0; i < (unsigned int)call_expr_nargs(fail_call); i++) {
+            if (!is_literal_arg(CALL_EXPR_ARG(fail_call, i))) {
+                CALL_EXPR_ARG(fail_call, i) = parm;
+                parm = DECL_CHAIN(parm);
+            }
+        }
+    }
+    if (output_mode == OUTPUT_WRITE) {
+        append_to_statement_list(make_output_flush(), &body);
+    }
+    if (fail_call != NULL_TREE) {
+        // the handler ends with the original call, so the program fails the same as it would without us.
+        append_to_statement_list(fail_call, &body);
+    }
+    finish_handler(fndecl, vars, body);
+
+    // the SAVE_EXPRs were already evaluated by the condition, and the other leaves are cheap to evaluate again.
+    return build_call_expr_loc_array(loc, fndecl, args.length(), args.address());
+}
+
+// builds a struct type of the given fields.
+static tree make_builtin_struct(const char *name, const char *const *names, const tree *types, unsigned int n) {
+    tree fields = NULL_TREE;
+    for (int i = n - 1; i >= 0; i--) {
+        tree field = build_decl(BUILTINS_LOCATION, FIELD_DECL, get_identifier(names[i]), types[i]);
+        DECL_CHAIN(field) = fields;
+        fields = field;
+    }
+
+    tree type = make_node(RECORD_TYPE);
+    finish_builtin_struct(type, name, fields, NULL_TREE);
+    return type;
+}
+
+// for soft mode: the per-site counters, in the layout of struct ai_soft_site (see ai_runtime.h).
+static tree soft_site_type;
+static tree soft_site_count_field;
+static unsigned int soft_site_count;
+
+static tree get_soft_site_type(void) {
+    if (soft_site_type != NULL_TREE) {
+        return soft_site_type;
+    }
+
+    const char *names[] = { "count", "expr", "file", "line", "limit" };
+    tree types[] = { long_long_unsigned_type_node, const_string_type_node, const_string_type_node,
+        unsigned_type_node, unsigned_type_node };
+
+    soft_site_type = make_builtin_struct("ai_soft_site", names, types, ARRAY_SIZE(names));
+    soft_site_count_field = TYPE_FIELDS(soft_site_type);
+    return soft_site_type;
+}
+
+// the argument of 'fail_call' with the text of the expression, per the layout of its function.
+static tree get_fail_expr_text(tree fail_call) {
+    const char *layout = get_fail_fn(fail_call)->layout;
+    const char *e = strchr(layout, 'e');
+
+    if (e == NULL || e - layout >= call_expr_nargs(fail_call)) {
+        return get_string_literal("?");
+    }
+    return unshare_expr(CALL_EXPR_ARG(fail_call, e - layout));
+}
+
+// creates the static counter of a site in soft mode, in the "ai_soft_sites" section so the runtime can find them.
+static tree make_soft_site(location_t loc, tree fail_call) {
+    tree type = get_soft_site_type();
+    const expanded_location xloc = expand_location(loc);
+
+    char name[32];
+    (void)snprintf(name, sizeof(name), "__ai_soft_site_%u", soft_site_count++);
+    tree var = build_decl(loc, VAR_DECL, get_identifier(name), type);
+    TREE_STATIC(var) = 1;
+    TREE_PUBLIC(var) = 0;
+    DECL_ARTIFICIAL(var) = 1;
+    TREE_USED(var) = 1;
+    // the runtime walks the section as an array, keep GCC from padding between the sites.
+    SET_DECL_ALIGN(var, TYPE_ALIGN(type));
+    DECL_USER_ALIGN(var) = 1;
+    set_decl_section_name(var, "ai_soft_sites");
+
+    tree field = soft_site_count_field;
+    tree values[] = {
+        build_zero_cst(long_long_unsigned_type_node),
+        get_fail_expr_text(fail_call),
+        get_string_literal(xloc.file),
+        build_int_cst(unsigned_type_node, xloc.line),
+        build_int_cst(unsigned_type_node, soft_limit),
+    };
+    vec<constructor_elt, va_gc> *elts = NULL;
+    for (unsigned int i = 0; i < ARRAY_SIZE(values); i++, field = DECL_CHAIN(field)) {
+        CONSTRUCTOR_APPEND_ELT(elts, field, fold_convert(TREE_TYPE(field), values[i]));
+    }
+    tree init = build_constructor(type, elts);
+    TREE_CONSTANT(init) = 1;
+    TREE_STATIC(init) = 1;
+    DECL_INITIAL(var) = init;
+
+    varpool_node::finalize_decl(var);
+    failure_decls.add(var);
+    return var;
+}
+
+// builds: if (__atomic_fetch_add(&site.count, 1, __ATOMIC_RELAXED) < limit) report;
+// failures past the limit cost just the increment, and are only seen in the runtime's summary.
+static tree make_soft_report(location_t loc, tree fail_call, tree report) {
+    tree site = make_soft_site(loc, fail_call);
+
+    tree count = build3(COMPONENT_REF, long_long_unsigned_type_node, site, soft_site_count_field, NULL_TREE);
+    tree inc = build_call_expr_loc(loc, builtin_decl_explicit(BUILT_IN_ATOMIC_FETCH_ADD_8), 3,
+        build_fold_addr_expr(count), build_int_cst(long_long_unsigned_type_node, 1),
+        build_int_cst(integer_type_node, MEMMODEL_RELAXED));
+    tree below = fold_build2(LT_EXPR, boolean_type_node, fold_convert(long_long_unsigned_type_node, inc),
+        build_int_cst(long_long_unsigned_type_node, soft_limit));
+
+    return build3(COND_EXPR, void_type_node, below, report, build_empty_stmt(loc));
+}
+
+// set by the "counters" plugin argument: count the evaluations & failures of each site, see ai_counter_site in
+// ai_runtime.h.
+static bool count_sites;
+static tree counter_slot_type;
+static tree counter_evaluations_field;
+static tree counter_failures_field;
+// the static slot of a site: the slot, padded to a cache line.
+static tree counter_line_type;
+static tree counter_line_slot_field;
+static tree counter_site_type;
+static tree counter_site_slot_field;
+static unsigned int counter_site_count;
+
+static void make_counter_types(void) {
+    if (counter_site_type != NULL_TREE) {
+        return;
+    }
+
+    const char *slot_names[] = { "evaluations", "failures" };
+    tree slot_types[] = { long_long_unsigned_type_node, long_long_unsigned_type_node };
+    counter_slot_type = make_builtin_struct("ai_counter_slot", slot_names, slot_types, ARRAY_SIZE(slot_names));
+    counter_evaluations_field = TYPE_FIELDS(counter_slot_type);
+    counter_failures_field = DECL_CHAIN(counter_evaluations_field);
+
+    const char *line_names[] = { "slot", "pad" };
+    tree line_types[] = { counter_slot_type,
+        build_array_type_nelts(char_type_node, 64 - tree_to_uhwi(TYPE_SIZE_UNIT(counter_slot_type))) };
+    counter_line_type = make_builtin_struct("ai_counter_line", line_names, line_types, ARRAY_SIZE(line_names));
+    counter_line_slot_field = TYPE_FIELDS(counter_line_type);
+
+    const char *site_names[] = { "slot", "id", "expr", "file", "line", "pad" };
+    tree site_types[] = { build_pointer_type(counter_slot_type), long_long_unsigned_type_node,
+        const_string_type_node, const_string_type_node, unsigned_type_node, unsigned_type_node };
+    counter_site_type = make_builtin_struct("ai_counter_site", site_names, site_types, ARRAY_SIZE(site_names));
+    counter_site_slot_field = TYPE_FIELDS(counter_site_type);
+}
+
+// creates the counters of a site: a zeroed slot on a cache line of its own, so counting doesn't bounce the lines
+// of other sites (or of the program's data) between CPUs, and the descriptor of the site pointing to it, in the
+// "ai_counter_sites" section so the runtime can find them.
+static tree make_counter_site(location_t loc, tree fail_call) {
+    make_counter_types();
+    const expanded_location xloc = expand_location(loc);
+    const unsigned int n = counter_site_count++;
+
+    char name[32];
+    (void)snprintf(name, sizeof(name), "__ai_counter_slot_%u", n);
+    tree slot = build_decl(loc, VAR_DECL, get_identifier(name), counter_line_type);
+    TREE_STATIC(slot) = 1;
+    TREE_PUBLIC(slot) = 0;
+    DECL_ARTIFICIAL(slot) = 1;
+    TREE_USED(slot) = 1;
+    SET_DECL_ALIGN(slot, 64 * BITS_PER_UNIT);
+    DECL_USER_ALIGN(slot) = 1;
+    varpool_node::finalize_decl(slot);
+
+    (void)snprintf(name, sizeof(name), "__ai_counter_site_%u", n);
+    tree site = build_decl(loc, VAR_DECL, get_identifier(name), counter_site_type);
+    TREE_STATIC(site) = 1;
+    TREE_PUBLIC(site) = 0;
+    DECL_ARTIFICIAL(site) = 1;
+    TREE_USED(site) = 1;
+    // the runtime walks the section as an array, keep GCC from padding between the sites.
+    SET_DECL_ALIGN(site, TYPE_ALIGN(counter_site_type));
+    DECL_USER_ALIGN(site) = 1;
+    set_decl_section_name(site, "ai_counter_sites");
+
+    char location[256];
+    (void)snprintf(location, sizeof(location), "%s:%d:%d", xloc.file, xloc.line, xloc.column);
+
+    tree field = counter_site_slot_field;
+    tree values[] = {
+        build_fold_addr_expr(build3(COMPONENT_REF, counter_slot_type, slot, counter_line_slot_field, NULL_TREE)),
+        build_int_cst(long_long_unsigned_type_node, hash_descriptor(location)),
+        get_fail_expr_text(fail_call),
+        get_string_literal(xloc.file),
+        build_int_cst(unsigned_type_node, xloc.line),
+        build_zero_cst(unsigned_type_node),
+    };
+    vec<constructor_elt, va_gc> *elts = NULL;
+    for (unsigned int i = 0; i < ARRAY_SIZE(values); i++, field = DECL_CHAIN(field)) {
+        CONSTRUCTOR_APPEND_ELT(elts, field, fold_convert(TREE_TYPE(field), values[i]));
+    }
+    tree init = build_constructor(counter_site_type, elts);
+    TREE_CONSTANT(init) = 1;
+    TREE_STATIC(init) = 1;
+    DECL_INITIAL(site) = init;
+
+    varpool_node::finalize_decl(site);
+    return site;
+}
+
+// &site.slot->field
+static tree make_counter_addr(location_t loc, tree site, tree field) {
+    tree slot = build3(COMPONENT_REF, TREE_TYPE(counter_site_slot_field), site, counter_site_slot_field, NULL_TREE);
+    tree counter = build3(COMPONENT_REF, long_long_unsigned_type_node, build_fold_indirect_ref_loc(loc, slot),
+        field, NULL_TREE);
+    return build_fold_addr_expr(counter);
+}
+
+// wraps a (patched) assert statement:
+//   __atomic_fetch_add(&evaluations, 1, RELAXED);
+//   cond ? (void)0 : (__atomic_fetch_add(&failures, 1, RELAXED), <failure path>);
+// both are exact under threads, so failures / evaluations is the failure rate of the site. the load of site.slot
+// can't alias the counts (by type), so GCC keeps it out of loops.
+static tree make_counted_assert(location_t loc, tree cond_expr, tree site) {
+    tree memmodel = build_int_cst(integer_type_node, MEMMODEL_RELAXED);
+
+    tree count = build_call_expr_loc(loc, builtin_decl_explicit(BUILT_IN_ATOMIC_FETCH_ADD_8), 3,
+        make_counter_addr(loc, site, counter_evaluations_field), build_int_cst(long_long_unsigned_type_node, 1),
+        memmodel);
+
+    tree failed = alloc_stmt_list();
+    append_to_statement_list(build_call_expr_loc(loc, builtin_decl_explicit(BUILT_IN_ATOMIC_FETCH_ADD_8), 3,
+        make_counter_addr(loc, site, counter_failures_field), build_int_cst(long_long_unsigned_type_node, 1),
+        memmodel), &failed);
+    append_to_statement_list(COND_EXPR_ELSE(cond_expr), &failed);
+    COND_EXPR_ELSE(cond_expr) = failed;
+
+    tree stmts = alloc_stmt_list();
+    append_to_statement_list(count, &stmts);
+    append_to_statement_list(cond_expr, &stmts);
+    return stmts;
+}
+
+// wraps the operand 'op' of a &&/|| in (mask |= (op ? 3 : 1) << 2 * slot, op), see truth_mask.
+static tree record_truth_value(tree op, tree var, unsigned int slot) {
+    tree ull = long_long_unsigned_type_node;
+    tree value = save_expr(op);
+
+    tree bits = fold_build2(LSHIFT_EXPR, ull, make_runtime_truth_value(value), build_int_cst(unsigned_type_node, 1));
+    bits = fold_build2(BIT_IOR_EXPR, ull, bits, build_int_cst(ull, 1));
+    bits = fold_build2(LSHIFT_EXPR, ull, bits, build_int_cst(unsigned_type_node, 2 * slot));
+    tree record = build2(MODIFY_EXPR, ull, var, fold_build2(BIT_IOR_EXPR, ull, var, bits));
+    TREE_SIDE_EFFECTS(record) = 1;
+
+    return build2(COMPOUND_EXPR, TREE_TYPE(op), record, value);
+}
+
+// makes the evaluation of 'expr' record the truth values of its operands in 'var', numbering the slots like
+// make_conditional_expr_repr does.
+static void record_truth_values(tree expr, tree var, unsigned int *slot) {
+    if (!is_truth_expr(expr)) {
+        return;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        const unsigned int op_slot = (*slot)++;
+        record_truth_values(TREE_OPERAND(expr, i), var, slot);
+        TREE_OPERAND(expr, i) = record_truth_value(TREE_OPERAND(expr, i), var, op_slot);
+    }
+    TREE_SIDE_EFFECTS(expr) = 1;
+}
+
+// a local variable of the current function, to declare in a BIND_EXPR.
+static tree make_local_var(location_t loc, const char *name, tree type) {
+    tree var = build_decl(loc, VAR_DECL, get_identifier(name), type);
+    DECL_CONTEXT(var) = current_function_decl;
+    DECL_ARTIFICIAL(var) = 1;
+    TREE_USED(var) = 1;
+    return var;
+}
+
+// the local variable holding the truth values of an assert, see truth_mask.
+static tree make_truth_mask_var(location_t loc) {
+    return make_local_var(loc, "__ai_truth", long_long_unsigned_type_node);
+}
+
+// builds { unsigned long long __ai_truth = 0; stmt }
+static tree make_truth_mask_bind(location_t loc, tree var, tree stmt) {
+    tree stmts = alloc_stmt_list();
+    append_to_statement_list(build2(MODIFY_EXPR, TREE_TYPE(var), var, build_zero_cst(TREE_TYPE(var))), &stmts);
+    append_to_statement_list(stmt, &stmts);
+
+    tree bind = build3(BIND_EXPR, void_type_node, var, stmts, NULL_TREE);
+    SET_EXPR_LOCATION(bind, loc);
+    return bind;
+}
+
+// rewrites the failure path of 'cond_expr' (in the assert shape, see normalize_assert). returns the truth mask
+// variable the rewritten assert uses, if any, which the caller has to declare around it: see make_truth_mask_bind.
+// 'index' is reported along with the condition, see take_assert_index.
+static tree patch_assert(tree cond_expr, tree index) {
+    plugin_timevar tv("assert_introspect patch_assert");
+    printf_decl = builtin_decl_explicit(BUILT_IN_PRINTF);
+
+    const location_t loc = EXPR_LOCATION(cond_expr);
+    tree fail_call = COND_EXPR_ELSE(cond_expr);
+    const bool soft = soft_limit >= 0;
+
+    auto_vec<tree> leaves;
+    wrap_leaves_in_save_expr(&COND_EXPR_COND(cond_expr), leaves, TREE_SIDE_EFFECTS(COND_EXPR_COND(cond_expr)));
+
+    // conditions with more sub-conditions than fit the mask test them again on failure.
+    const unsigned int nslots = count_truth_slots(COND_EXPR_COND(cond_expr));
+    tree mask = nslots > 0 && nslots <= MAX_TRUTH_SLOTS ? make_truth_mask_var(loc) : NULL_TREE;
+
+    tree report;
+    if (output_mode == OUTPUT_DESC) {
+        report = make_descriptor_report(loc, COND_EXPR_COND(cond_expr), mask, index);
+    } else if (output_mode == OUTPUT_BINLOG) {
+        report = make_binlog_report(loc, COND_EXPR_COND(cond_expr), mask, index);
+    } else {
+        // the handler makes the original call itself, unless we're soft.
+        report = make_handler_report(loc, COND_EXPR_COND(cond_expr), leaves, soft ? NULL_TREE : fail_call, mask,
+            index);
+    }
+
+    // only now: the reports above were built from the condition as written.
+    if (mask != NULL_TREE) {
+        unsigned int slot = 0;
+        record_truth_values(COND_EXPR_COND(cond_expr), mask, &slot);
+    }
+
+    if (soft) {
+        // the original call is dropped, we log & go on.
+        COND_EXPR_ELSE(cond_expr) = make_soft_report(loc, fail_call, report);
+    } else if (output_mode == OUTPUT_DESC || output_mode == OUTPUT_BINLOG) {
+        // no handler here - the failure path is the runtime call followed by the original call.
+        tree stmts = alloc_stmt_list();
+        append_to_statement_list(report, &stmts);
+        append_to_statement_list(fail_call, &stmts);
+        COND_EXPR_ELSE(cond_expr) = stmts;
+    } else {
+        COND_EXPR_ELSE(cond_expr) = report;
+    }
+
+    return mask;
+}
+
+// set by the "policy" plugin argument: pick the check of each site by its execution count under -fprofile-use.
+// sites reached less than 'policy_warm' times are fully checked, less than 'policy_hot' times are sampled, and
+// hotter ones are dropped, or turned into hints with "hot-policy=assume". see assert_policy_pass.
+static bool profile_policy;
+static unsigned long long policy_warm = 1000;
+static unsigned long long policy_hot = 100000;
+static bool policy_hot_assume;
+// "policy-report": where to list the policy picked for each site. defaults to <source>.ai-policy.
+static const char *policy_report_file;
+
+// sampling, set by the "sample" plugin argument, or per function by __attribute__((assert_sample(N))):
+// if > 1, each site evaluates its assert once every 'sample_period' times it's reached, per thread.
+// the attribute overrides the argument, so assert_sample(1) turns sampling off for a function.
+static unsigned long sample_period;
+// the period of the function being processed.
+static unsigned long current_sample_period;
+static unsigned int sample_counter_count;
+
+// creates the thread-local countdown of a sampled site. it starts at 1, so the first pass of each thread is checked.
+static tree make_sample_counter(location_t loc) {
+    char name[32];
+    (void)snprintf(name, sizeof(name), "__ai_sample_%u", sample_counter_count++);
+    tree var = build_decl(loc, VAR_DECL, get_identifier(name), unsigned_type_node);
+    TREE_STATIC(var) = 1;
+    TREE_PUBLIC(var) = 0;
+    DECL_ARTIFICIAL(var) = 1;
+    TREE_USED(var) = 1;
+    DECL_INITIAL(var) = build_int_cst(unsigned_type_node, 1);
+    set_decl_tls_model(var, decl_default_tls_model(var));
+
+    varpool_node::finalize_decl(var);
+    return var;
+}
+
+// the countdowns of all sampled sites, see assert_policy_pass.
+static hash_set<tree> sample_counters;
+
+// wraps a (patched) assert statement:
+//   if (__builtin_expect(--__ai_sample_N == 0, 0)) { __ai_sample_N = period; <assert> }
+// so passing runs skip the condition entirely most of the time. failing samples go through the same
+// introspection as before.
+static tree make_sampled_assert(location_t loc, tree stmt, unsigned long period) {
+    tree counter = make_sample_counter(loc);
+    sample_counters.add(counter);
+
+    tree dec = build2(PREDECREMENT_EXPR, unsigned_type_node, counter, build_int_cst(unsigned_type_node, 1));
+    tree due = build2(EQ_EXPR, long_integer_type_node, dec, build_int_cst(unsigned_type_node, 0));
+    due = build_call_expr_loc(loc, builtin_decl_explicit(BUILT_IN_EXPECT), 2, due,
+        build_int_cst(long_integer_type_node, 0));
+    due = build2(NE_EXPR, boolean_type_node, due, build_int_cst(long_integer_type_node, 0));
+
+    tree then = alloc_stmt_list();
+    append_to_statement_list(build2_loc(loc, MODIFY_EXPR, unsigned_type_node, counter,
+        build_int_cst(unsigned_type_node, period)), &then);
+    append_to_statement_list(stmt, &then);
+
+    tree sampled = build3(COND_EXPR, void_type_node, due, then, build_empty_stmt(loc));
+    SET_EXPR_LOCATION(sampled, loc);
+    return sampled;
+}
+
+// for assume mode: returns a statement telling GCC the condition of the assert holds, without checking it,
+// or NULL_TREE if the condition has side effects - those asserts are left as they are, we don't drop calls.
+// the facts (n % 4 == 0, p != NULL) are then available to VRP, the vectorizer etc.
+static tree make_assume(tree cond_expr) {
+    tree cond = COND_EXPR_COND(cond_expr);
+    const location_t loc = EXPR_LOCATION(cond_expr);
+
+    if (TREE_SIDE_EFFECTS(cond)) {
+        return NULL_TREE;
+    }
+
+#if GCCPLUGIN_VERSION >= 13001
+    // same as __attribute__((assume(cond))): the condition isn't evaluated at all, even if it reads memory.
+    return build_call_expr_internal_loc(loc, IFN_ASSUME, void_type_node, 1, cond);
+#else
+    // if (!cond) __builtin_unreachable(); - the evaluation itself is dead code once the hint is used.
+    return build3_loc(loc, COND_EXPR, void_type_node, cond, build_empty_stmt(loc),
+        build_call_expr_loc(loc, builtin_decl_explicit(BUILT_IN_UNREACHABLE), 0));
+#endif
+}
+
+// an empty arm of the COND_EXPR of an assert: "(void)0", or a missing else.
+static bool is_empty_arm(tree arm) {
+    // "void(0)" in C++ is a CONVERT_EXPR.
+    return arm == NULL_TREE || (CONVERT_EXPR_P(arm) && VOID_TYPE_P(TREE_TYPE(arm)) && !TREE_SIDE_EFFECTS(arm));
+}
+
+// the arm of the COND_EXPR of an assert taken when it holds: an empty one, or a call to the pass function of 'fn'.
+static bool is_pass_arm(tree arm, const fail_fn *fn) {
+    if (is_empty_arm(arm)) {
+        return true;
+    }
+    if (fn->pass_id == NULL_TREE || TREE_CODE(arm) != CALL_EXPR) {
+        return false;
+    }
+
+    tree fndecl = get_callee_fndecl(arm);
+    return fndecl != NULL_TREE && DECL_NAME(fndecl) == fn->pass_id && is_file_scope(fndecl);
+}
+
+// matches "cond ? (void)0 : fail(...)" (the assert macro), and the swapped "if (cond) fail(...)" of check-style
+// macros, for any of the registered fail functions. the empty arm may be a call to the pass function instead.
+static bool is_assert_fail_cond_expr(tree expr) {
+    if (TREE_CODE(expr) != COND_EXPR) {
+        return false;
+    }
+
+    const fail_fn *fn;
+    return (
+        ((fn = get_fail_fn(COND_EXPR_ELSE(expr))) != NULL && is_pass_arm(COND_EXPR_THEN(expr), fn)) ||
+        ((fn = get_fail_fn(COND_EXPR_THEN(expr))) != NULL && is_pass_arm(COND_EXPR_ELSE(expr), fn))
+    );
+}
+
+// brings the swapped shape to the assert one: the condition is what must hold, the else is the fail call, and the
+// then the passing arm.
+// drops the conversions to bool of truth values (static_cast<bool>(a == b) in the C++ assert), in 'expr' and its
+// &&/|| operands. otherwise the whole comparison would be a single leaf.
+static tree strip_truth_conversions(tree expr) {
+    while (CONVERT_EXPR_P(expr) && TREE_CODE(TREE_TYPE(expr)) == BOOLEAN_TYPE &&
+        truth_value_p(TREE_CODE(TREE_OPERAND(expr, 0)))) {
+        expr = TREE_OPERAND(expr, 0);
+    }
+
+    const enum tree_code code = TREE_CODE(expr);
+    if (code == TRUTH_ANDIF_EXPR || code == TRUTH_AND_EXPR || code == TRUTH_ORIF_EXPR || code == TRUTH_OR_EXPR) {
+        TREE_OPERAND(expr, 0) = strip_truth_conversions(TREE_OPERAND(expr, 0));
+        TREE_OPERAND(expr, 1) = strip_truth_conversions(TREE_OPERAND(expr, 1));
+    }
+    return expr;
+}
+
+static void normalize_assert(tree cond_expr) {
+    COND_EXPR_COND(cond_expr) = strip_truth_conversions(COND_EXPR_COND(cond_expr));
+    if (get_fail_fn(COND_EXPR_ELSE(cond_expr)) != NULL) {
+        return;
+    }
+
+    const location_t loc = EXPR_LOCATION(cond_expr);
+    tree fail_call = COND_EXPR_THEN(cond_expr);
+    tree pass = COND_EXPR_ELSE(cond_expr);
+    COND_EXPR_COND(cond_expr) = invert_truthvalue_loc(loc, COND_EXPR_COND(cond_expr));
+    COND_EXPR_THEN(cond_expr) = pass != NULL_TREE ? pass : build_empty_stmt(loc);
+    COND_EXPR_ELSE(cond_expr) = fail_call;
+}
+
+// the calls of ai_assert_all.h marking the index of the element an assert checks: "(__ai_assert_index(i), cond)".
+static bool is_assert_index_marker(tree call) {
+    if (TREE_CODE(call) != CALL_EXPR || call_expr_nargs(call) != 1) {
+        return false;
+    }
+
+    tree fndecl = get_callee_fndecl(call);
+    return fndecl != NULL_TREE && DECL_NAME(fndecl) != NULL_TREE &&
+        0 == strcmp(IDENTIFIER_POINTER(DECL_NAME(fndecl)), "__ai_assert_index");
+}
+
+// the asserts lower_assert_loop has moved out of their loops, with the variable holding the index of the first
+// failing element. emptied after each function.
+static hash_map<tree, tree> assert_indexes;
+
+// if 'cond_expr' checks an element of an array, returns its index: for the asserts of ai_assert_all.h, the marker
+// is taken out of the condition.
+static tree take_assert_index(tree cond_expr) {
+    tree *index = assert_indexes.get(cond_expr);
+    if (index != NULL) {
+        return *index;
+    }
+
+    tree cond = COND_EXPR_COND(cond_expr);
+    // C++ converts the whole comma expression to bool.
+    while (CONVERT_EXPR_P(cond)) {
+        cond = TREE_OPERAND(cond, 0);
+    }
+    if (TREE_CODE(cond) != COMPOUND_EXPR || !is_assert_index_marker(TREE_OPERAND(cond, 0))) {
+        return NULL_TREE;
+    }
+
+    COND_EXPR_COND(cond_expr) = fold_convert(TREE_TYPE(COND_EXPR_COND(cond_expr)), TREE_OPERAND(cond, 1));
+    return CALL_EXPR_ARG(TREE_OPERAND(cond, 0), 0);
+}
+
+static tree find_variable_r(tree *tp, int *walk_subtrees, void *data) {
+    if (TYPE_P(*tp)) {
+        *walk_subtrees = 0;
+        return NULL_TREE;
+    }
+    return DECL_P(*tp) || TREE_CODE(*tp) == CALL_EXPR ? *tp : NULL_TREE;
+}
+
+// whether a condition is made of literals only, like assert(0), assert(!"unreachable") or assert(0 && "msg"):
+// those are false on purpose, while a condition folding to false despite reading something is likely a mistake.
+static bool is_literal_cond(tree cond) {
+    return walk_tree_without_duplicates(&cond, find_variable_r, NULL) == NULL_TREE;
+}
+
+// rewrites the assert at 'site' in place.
+static void rewrite_assert(tree *site) {
+    tree cond_expr = *site;
+    tree index = take_assert_index(cond_expr);
+    normalize_assert(cond_expr);
+
+    // asserts that are constant after folding (sizeof checks, macros expanding to constants) don't need any of
+    // this. true ones are left for GCC to drop, false ones still get rewritten, and are worth a warning unless they
+    // were written that way.
+    tree folded = fold(COND_EXPR_COND(cond_expr));
+    if (TREE_CODE(folded) == INTEGER_CST) {
+        if (!integer_zerop(folded)) {
+            return;
+        }
+        if (warn_always_false && !is_literal_cond(COND_EXPR_COND(cond_expr))) {
+            warning_at(EXPR_LOCATION(cond_expr), 0, "assertion is always false");
+        }
+    }
+
+    if (assume_mode) {
+        tree assume = make_assume(cond_expr);
+        if (assume != NULL_TREE) {
+            // the call to the pass function (see fail_fn) is still made.
+            if (!is_empty_arm(COND_EXPR_THEN(cond_expr))) {
+                tree stmts = alloc_stmt_list();
+                append_to_statement_list(assume, &stmts);
+                append_to_statement_list(COND_EXPR_THEN(cond_expr), &stmts);
+                assume = stmts;
+            }
+            *site = assume;
+        }
+        return;
+    }
+
+    // the descriptor has to be made while the fail call is still there.
+    const location_t loc = EXPR_LOCATION(cond_expr);
+    tree counter_site = count_sites ? make_counter_site(loc, COND_EXPR_ELSE(cond_expr)) : NULL_TREE;
+
+    tree mask = patch_assert(cond_expr, index);
+    tree stmt = cond_expr;
+    if (counter_site != NULL_TREE) {
+        stmt = make_counted_assert(loc, cond_expr, counter_site);
+    }
+    if (mask != NULL_TREE) {
+        stmt = make_truth_mask_bind(loc, mask, stmt);
+    }
+
+    // sampled sites count the evaluations they actually make.
+    if (profile_policy) {
+        // the policy pass picks the period. the GENERIC must be the same for -fprofile-generate and -fprofile-use,
+        // or the profile won't match, so every site gets the sampled form.
+        *site = make_sampled_assert(loc, stmt, 1);
+    } else if (current_sample_period > 1) {
+        *site = make_sampled_assert(loc, stmt, current_sample_period);
+    } else {
+        *site = stmt;
+    }
+}
+
+// what the walk of iterate_function_body collects.
+struct body_sites {
+    auto_vec<tree *> asserts;
+    // the loops lower_assert_loop may rewrite. not collected in assume mode, see iterate_function_body.
+    auto_vec<tree *> loops;
+    bool collect_loops;
+};
+
+static tree collect_asserts_r(tree *tp, int *walk_subtrees, void *data) {
+    body_sites *sites = (body_sites *)data;
+
+    if (TYPE_P(*tp)) {
+        *walk_subtrees = 0;
+    } else if (is_assert_fail_cond_expr(*tp)) {
+        sites->asserts.safe_push(tp);
+        // nothing to look for inside.
+        *walk_subtrees = 0;
+#if GCCPLUGIN_VERSION >= 12001
+    } else if (sites->collect_loops && TREE_CODE(*tp) == FOR_STMT) {
+        // nested loops are walked too, only innermost ones can have an assert as their body.
+        sites->loops.safe_push(tp);
+#endif
+    }
+    return NULL_TREE;
+}
+
+#if GCCPLUGIN_VERSION >= 12001
+// where the single statement of a loop body is, through braces and C++ full expressions, or NULL.
+static tree *get_single_stmt(tree *body) {
+    for (;;) {
+        if (TREE_CODE(*body) == STATEMENT_LIST) {
+            tree *stmt = NULL;
+            for (tree_stmt_iterator it = tsi_start(*body); !tsi_end_p(it); tsi_next(&it)) {
+                if (TREE_CODE(tsi_stmt(it)) == DEBUG_BEGIN_STMT) {
+                    continue;
+                }
+                if (stmt != NULL) {
+                    return NULL;
+                }
+                stmt = tsi_stmt_ptr(it);
+            }
+            if (stmt == NULL) {
+                return NULL;
+            }
+            body = stmt;
+        } else if (TREE_CODE(*body) == BIND_EXPR && BIND_EXPR_VARS(*body) == NULL_TREE) {
+            body = &BIND_EXPR_BODY(*body);
+        } else if (TREE_CODE(*body) == CLEANUP_POINT_EXPR) {
+            // C++ full expressions. an element condition has no temporaries to clean up, see find_non_element_cond_r.
+            body = &TREE_OPERAND(*body, 0);
+        } else {
+            return body;
+        }
+    }
+}
+
+// the counter of "for (...; i < bound; i++)" (or ++i, i += step), if 'loop' is such a loop over an integer. the
+// initialization must come before the loop, as in C: C++ loops declaring their counter aren't handled.
+static tree get_loop_counter(tree loop, tree *step_ptr) {
+    tree cond = FOR_COND(loop);
+    tree incr = FOR_EXPR(loop);
+    if (FOR_INIT_STMT(loop) != NULL_TREE || cond == NULL_TREE || incr == NULL_TREE || TREE_CODE(cond) != LT_EXPR) {
+        return NULL_TREE;
+    }
+
+    tree i = TREE_OPERAND(cond, 0);
+    if (!VAR_P(i) || !INTEGRAL_TYPE_P(TREE_TYPE(i)) || TREE_THIS_VOLATILE(i)) {
+        return NULL_TREE;
+    }
+
+    tree step;
+    if ((TREE_CODE(incr) == POSTINCREMENT_EXPR || TREE_CODE(incr) == PREINCREMENT_EXPR) &&
+        TREE_OPERAND(incr, 0) == i) {
+        step = TREE_OPERAND(incr, 1);
+    } else if (TREE_CODE(incr) == MODIFY_EXPR && TREE_OPERAND(incr, 0) == i &&
+        TREE_CODE(TREE_OPERAND(incr, 1)) == PLUS_EXPR && TREE_OPERAND(TREE_OPERAND(incr, 1), 0) == i) {
+        step = TREE_OPERAND(TREE_OPERAND(incr, 1), 1);
+    } else {
+        return NULL_TREE;
+    }
+    if (TREE_CODE(step) != INTEGER_CST || tree_int_cst_sgn(step) <= 0) {
+        return NULL_TREE;
+    }
+    *step_ptr = step;
+    return i;
+}
+
+// stops at what an element condition can't have: it's evaluated for all elements, and copied.
+static tree find_non_element_cond_r(tree *tp, int *walk_subtrees, void *data) {
+    const enum tree_code code = TREE_CODE(*tp);
+    return code == CALL_EXPR || code == SAVE_EXPR || code == TARGET_EXPR || code == BIND_EXPR ? *tp : NULL_TREE;
+}
+
+static tree find_decl_r(tree *tp, int *walk_subtrees, void *data) {
+    return *tp == (tree)data ? *tp : NULL_TREE;
+}
+
+// replaces uses of decls[0] by decls[1].
+static tree replace_decl_r(tree *tp, int *walk_subtrees, void *data) {
+    tree *decls = (tree *)data;
+    if (*tp == decls[0]) {
+        *tp = decls[1];
+    } else if (TYPE_P(*tp)) {
+        *walk_subtrees = 0;
+    }
+    return NULL_TREE;
+}
+
+// "for (...; i < n; i++) assert(cond(a[i]));" keeps the vectorizer away from the loop, and reports the element but
+// not its index. if the loop at 'tp' is one of those, rewrites it to
+//   index = i;
+//   ok = 1;
+//   for (...; i < n; i++) ok &= cond(a[i]) ? 1 : 0;
+//   if (!ok) { for (; cond(a[index]); index++); assert(cond(a[index])); }
+// an AND reduction, which vectorizes, and a scalar rescan from the first element only if one has failed. the assert
+// then reports the first failing element, with its index (see take_assert_index). the condition must be cheap and
+// pure, and can't trap: it's evaluated for all elements, even after one fails. that rules out most loads (a[i] may be
+// out of bounds past the failing element), ai_assert_all.h is for those. and only the first failure is reported,
+// so the fail function must not return, and soft mode is off.
+// the assert moves: its site in the loop body is mapped to the new one in 'moved'.
+static bool lower_assert_loop(tree *tp, hash_map<tree *, tree *> &moved) {
+    tree loop = *tp;
+    tree step;
+    tree i = get_loop_counter(loop, &step);
+    tree *site = FOR_BODY(loop) != NULL_TREE ? get_single_stmt(&FOR_BODY(loop)) : NULL;
+    if (i == NULL_TREE || site == NULL || !is_assert_fail_cond_expr(*site)) {
+        return false;
+    }
+    tree stmt = *site;
+
+    normalize_assert(stmt);
+    tree cond = COND_EXPR_COND(stmt);
+    tree fail_fn = get_callee_fndecl(COND_EXPR_ELSE(stmt));
+    if (soft_limit >= 0 || fail_fn == NULL_TREE || !TREE_THIS_VOLATILE(fail_fn)) {
+        return false;
+    }
+    // a call to the pass function has to be made for each element.
+    if (!is_empty_arm(COND_EXPR_THEN(stmt)) || TREE_SIDE_EFFECTS(cond) || generic_expr_could_trap_p(cond) ||
+        walk_tree_without_duplicates(&cond, find_non_element_cond_r, NULL) != NULL_TREE ||
+        walk_tree_without_duplicates(&cond, find_decl_r, i) == NULL_TREE) {
+        return false;
+    }
+
+    const location_t loc = EXPR_LOCATION(stmt);
+    tree type = TREE_TYPE(i);
+    tree index = make_local_var(loc, "__ai_index", type);
+    tree ok = make_local_var(loc, "__ai_ok", integer_type_node);
+    DECL_CHAIN(index) = ok;
+
+    tree passed = build3(COND_EXPR, integer_type_node, unshare_expr(cond), integer_one_node, integer_zero_node);
+    FOR_BODY(loop) = build2(MODIFY_EXPR, integer_type_node, ok, build2(BIT_AND_EXPR, integer_type_node, ok, passed));
+
+    // the assert, on the element at 'index'.
+    tree decls[] = { i, index };
+    COND_EXPR_COND(stmt) = unshare_expr(cond);
+    walk_tree(&COND_EXPR_COND(stmt), replace_decl_r, decls, NULL);
+    assert_indexes.put(stmt, index);
+
+    // an element has failed, so this stops before the bound of the loop.
+    tree rescan = alloc_stmt_list();
+    tree found = build1(EXIT_EXPR, void_type_node, invert_truthvalue_loc(loc, unshare_expr(COND_EXPR_COND(stmt))));
+    TREE_SIDE_EFFECTS(found) = 1;
+    append_to_statement_list(found, &rescan);
+    append_to_statement_list(build2(MODIFY_EXPR, type, index, fold_build2(PLUS_EXPR, type, index,
+        fold_convert(type, step))), &rescan);
+    rescan = build1(LOOP_EXPR, void_type_node, rescan);
+    TREE_SIDE_EFFECTS(rescan) = 1;
+
+    tree failed = alloc_stmt_list();
+    append_to_statement_list(rescan, &failed);
+    append_to_statement_list(stmt, &failed);
+    moved.put(site, tsi_stmt_ptr(tsi_last(failed)));
+
+    tree stmts = alloc_stmt_list();
+    append_to_statement_list(build2(MODIFY_EXPR, type, index, i), &stmts);
+    append_to_statement_list(build2(MODIFY_EXPR, integer_type_node, ok, integer_one_node), &stmts);
+    append_to_statement_list(loop, &stmts);
+    append_to_statement_list(build3_loc(loc, COND_EXPR, void_type_node, build2(EQ_EXPR, boolean_type_node, ok,
+        integer_zero_node), failed, build_empty_stmt(loc)), &stmts);
+    *tp = build3(BIND_EXPR, void_type_node, index, stmts, NULL_TREE);
+    TREE_SIDE_EFFECTS(*tp) = 1;
+    return true;
+}
+
+// lowers the assert loops found by the walk, see lower_assert_loop. the sites of the asserts they had are updated.
+static void lower_assert_loops(body_sites &sites) {
+    if (sites.loops.is_empty()) {
+        return;
+    }
+    plugin_timevar tv("assert_introspect lower loops");
+    hash_map<tree *, tree *> moved;
+
+    unsigned int i;
+    tree *loop;
+    FOR_EACH_VEC_ELT(sites.loops, i, loop) {
+        if (lower_assert_loop(loop, moved)) {
+            stats.loops++;
+        }
+    }
+    if (moved.elements() == 0) {
+        return;
+    }
+
+    tree *site;
+    FOR_EACH_VEC_ELT(sites.asserts, i, site) {
+        tree **to = moved.get(site);
+        if (to != NULL) {
+            sites.asserts[i] = *to;
+        }
+    }
+}
+#endif
+
+// finds all asserts in the body - in nested blocks, if/loop/switch bodies, statement expressions etc. - in one walk,
+// along with the loops lower_assert_loop may rewrite.
+// the visited set keeps shared subtrees from being walked more than once, so this stays linear in the tree size.
+// the asserts are rewritten only after the walk, so it doesn't go into the trees we build.
+static void iterate_function_body(tree *body) {
+    body_sites sites;
+    // in assume mode, only the single assert would be left, not the loop.
+    sites.collect_loops = !assume_mode;
+    {
+        plugin_timevar tv("assert_introspect walk");
+        hash_set<tree> visited;
+        walk_tree(body, collect_asserts_r, &sites, &visited);
+    }
+#if GCCPLUGIN_VERSION >= 12001
+    lower_assert_loops(sites);
+#endif
+
+    unsigned int i;
+    tree *site;
+    FOR_EACH_VEC_ELT(sites.asserts, i, site) {
+        if (print_stats) {
+            // the original condition is kept in the rewritten site, this counts what was added around it.
+            long before = count_tree_nodes(*site);
+            rewrite_assert(site);
+            stats.tree_nodes += count_tree_nodes(*site) - before;
+        } else {
+            rewrite_assert(site);
+        }
+    }
+    stats.asserts += sites.asserts.length();
+    assert_indexes.empty();
+}
+
+// set by the "scope" plugin argument: if "annotated", only functions marked by __attribute__((assert_introspect))
+// or following "#pragma assert_introspect on" are rewritten. otherwise all are, but the ones marked by
+// __attribute__((no_assert_introspect)) or following "#pragma assert_introspect off".
+static bool annotated_only;
+
+// the last "#pragma assert_introspect" parsed: on, off, or default (the scope decides).
+enum pragma_scope {
+    PRAGMA_SCOPE_DEFAULT,
+    PRAGMA_SCOPE_ON,
+    PRAGMA_SCOPE_OFF,
+};
+
+static enum pragma_scope pragma_scope = PRAGMA_SCOPE_DEFAULT;
+
+// the pragma in effect where a function is defined, kept on its decl: the body is genericized later (at the end
+// of the TU for templates & inline functions), when 'pragma_scope' may have changed. the space keeps it from being
+// written in the source.
+#define PRAGMA_SCOPE_ATTRIBUTE "assert_introspect scope"
+
+// records 'pragma_scope' on the function whose definition starts. template instantiations get it from their
+// pattern, along with the other attributes. members defined in a class body are parsed at the end of the outermost
+// class, so a pragma inside a class body applies to them from there.
+static void start_parse_function_callback(void *event_data, void *user_data) {
+    tree fndecl = (tree)event_data;
+    if (pragma_scope == PRAGMA_SCOPE_DEFAULT || fndecl == NULL_TREE || TREE_CODE(fndecl) != FUNCTION_DECL) {
+        return;
+    }
+
+    tree value = build_tree_list(NULL_TREE, pragma_scope == PRAGMA_SCOPE_ON ? integer_one_node : integer_zero_node);
+    DECL_ATTRIBUTES(fndecl) = tree_cons(get_identifier(PRAGMA_SCOPE_ATTRIBUTE), value, DECL_ATTRIBUTES(fndecl));
+}
+
+// attributes win over the pragma, which wins over the scope.
+static bool in_scope(tree fndecl) {
+    if (lookup_attribute("no_assert_introspect", DECL_ATTRIBUTES(fndecl)) != NULL_TREE) {
+        return false;
+    }
+    if (lookup_attribute("assert_introspect", DECL_ATTRIBUTES(fndecl)) != NULL_TREE) {
+        return true;
+    }
+    tree pragma = lookup_attribute(PRAGMA_SCOPE_ATTRIBUTE, DECL_ATTRIBUTES(fndecl));
+    if (pragma != NULL_TREE) {
+        return integer_onep(TREE_VALUE(TREE_VALUE(pragma)));
+    }
+    return !annotated_only;
+}
+
+static void pre_genericize_callback(void *event_data, void *user_data) {
+    tree t = (tree)event_data;
+
+    // most functions have no asserts, make them cost as little as possible. until __assert_fail is declared,
+    // nothing can call it. past that, functions without asserts only cost the one walk of iterate_function_body.
+    if (TREE_CODE(t) == FUNCTION_DECL && in_scope(t) && resolve_fail_fns()) {
+        plugin_timevar tv("assert_introspect pre_genericize");
+        stats.functions++;
+        current_fndecl = t;
+        current_sample_period = sample_period;
+        tree attr = lookup_attribute("assert_sample", DECL_ATTRIBUTES(t));
+        if (attr != NULL_TREE) {
+            current_sample_period = TREE_INT_CST_LOW(TREE_VALUE(TREE_VALUE(attr)));
+        }
+
+        void *mark = obstack_alloc(&function_obstack, 0);
+        iterate_function_body(&DECL_SAVED_TREE(t));
+        stats.function_memory_peak = MAX(stats.function_memory_peak, obstack_memory_used(&function_obstack));
+        obstack_free(&function_obstack, mark);
+    }
+}
+
+static tree handle_assert_sample_attribute(tree *node, tree name, tree args, int flags, bool *no_add_attrs) {
+    tree period = TREE_VALUE(args);
+
+    if (TREE_CODE(period) != INTEGER_CST || tree_int_cst_sgn(period) <= 0 || !tree_fits_uhwi_p(period) ||
+        tree_to_uhwi(period) > UINT_MAX) {
+        warning(OPT_Wattributes, "%qE attribute requires a positive integer constant", name);
+        *no_add_attrs = true;
+    }
+
+    return NULL_TREE;
+}
+
+static struct attribute_spec assert_sample_attribute = {
+#if GCCPLUGIN_VERSION >= 8001
+    "assert_sample", 1, 1, true, false, false, false, handle_assert_sample_attribute, NULL
+#else
+    "assert_sample", 1, 1, true, false, false, handle_assert_sample_attribute, false
+#endif
+};
+
+static struct attribute_spec assert_introspect_attributes[] = {
+#if GCCPLUGIN_VERSION >= 8001
+    { "assert_introspect", 0, 0, true, false, false, false, NULL, NULL },
+    { "no_assert_introspect", 0, 0, true, false, false, false, NULL, NULL },
+#else
+    { "assert_introspect", 0, 0, true, false, false, NULL, false },
+    { "no_assert_introspect", 0, 0, true, false, false, NULL, false },
+#endif
+};
+
+static void attributes_callback(void *event_data, void *user_data) {
+    register_attribute(&assert_sample_attribute);
+    for (unsigned int i = 0; i < ARRAY_SIZE(assert_introspect_attributes); i++) {
+        register_attribute(&assert_introspect_attributes[i]);
+    }
+}
+
+// #pragma assert_introspect on|off|default - applies to the functions defined after it.
+static void handle_assert_introspect_pragma(cpp_reader *reader) {
+    tree arg;
+    if (pragma_lex(&arg) != CPP_NAME) {
+        warning(OPT_Wpragmas, "expected on, off or default after %<#pragma assert_introspect%>");
+        return;
+    }
+
+    const char *value = IDENTIFIER_POINTER(arg);
+    if (0 == strcmp(value, "on")) {
+        pragma_scope = PRAGMA_SCOPE_ON;
+    } else if (0 == strcmp(value, "off")) {
+        pragma_scope = PRAGMA_SCOPE_OFF;
+    } else if (0 == strcmp(value, "default")) {
+        pragma_scope = PRAGMA_SCOPE_DEFAULT;
+    } else {
+        warning(OPT_Wpragmas, "unknown %<#pragma assert_introspect%> argument %qs", value);
+    }
+}
+
+static void pragmas_callback(void *event_data, void *user_data) {
+    c_register_pragma(NULL, "assert_introspect", handle_assert_introspect_pragma);
+}
+
+#if GCCPLUGIN_VERSION >= 8001
+// whether 'stmt' is one of the statements a rewritten assert runs only when it fails.
+static bool is_failure_stmt(gimple *stmt) {
+    if (!is_gimple_call(stmt)) {
+        return false;
+    }
+
+    tree fndecl = gimple_call_fndecl(stmt);
+    if (fndecl == NULL_TREE) {
+        return false;
+    }
+    if (find_fail_fn(fndecl) >= 0 || fndecl == ai_report_decl || fndecl == ai_log_decl ||
+        failure_decls.contains(fndecl)) {
+        return true;
+    }
+
+    // soft mode: the increment of the site's counter is the start of the failure path.
+    if (gimple_call_num_args(stmt) > 0 && TREE_CODE(gimple_call_arg(stmt, 0)) == ADDR_EXPR) {
+        tree base = get_base_address(TREE_OPERAND(gimple_call_arg(stmt, 0), 0));
+        return base != NULL_TREE && failure_decls.contains(base);
+    }
+    return false;
+}
+
+// for the stats: the size estimate of the statements of 'bb'.
+static unsigned int estimate_block_size(basic_block bb) {
+    unsigned int size = 0;
+    for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi); gsi_next(&gsi)) {
+        size += estimate_num_insns(gsi_stmt(gsi), &eni_size_weights);
+    }
+    return size;
+}
+
+static const pass_data assert_cold_pass_data = {
+    GIMPLE_PASS,
+    "assert_introspect_cold", // name
+    OPTGROUP_NONE,
+    TV_NONE,
+    PROP_cfg, // properties_required
+    0, // properties_provided
+    0, // properties_destroyed
+    0, // todo_flags_start
+    0, // todo_flags_finish
+};
+
+// the rewrite happens on GENERIC, where there's no CFG or profile yet. it isn't moved to GIMPLE, so it gets nothing
+// from LTO (see README.md): only this marking is. this pass runs after the profile is estimated, and marks the edges
+// into the failure paths of rewritten asserts as never taken: the blocks of the failure paths get a zero count, so
+// block reordering moves them out of the way of the hot code, and hot/cold partitioning
+// (-freorder-blocks-and-partition) puts them in .text.unlikely.
+struct assert_cold_pass : gimple_opt_pass {
+    assert_cold_pass(gcc::context *ctx) : gimple_opt_pass(assert_cold_pass_data, ctx) {
+    }
+
+    virtual unsigned int execute(function *fun) override {
+        if (print_stats && failure_decls.contains(fun->decl)) {
+            // a handler: it's all failure path.
+            basic_block bb;
+            FOR_EACH_BB_FN(bb, fun) {
+                stats.size_estimate += estimate_block_size(bb);
+            }
+            return 0;
+        }
+
+        auto_vec<basic_block> failing;
+        hash_set<basic_block> counted;
+        basic_block bb;
+        FOR_EACH_BB_FN(bb, fun) {
+            for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi); gsi_next(&gsi)) {
+                if (is_failure_stmt(gsi_stmt(gsi))) {
+                    failing.safe_push(bb);
+                    break;
+                }
+            }
+        }
+
+        unsigned int i;
+        FOR_EACH_VEC_ELT(failing, i, bb) {
+            // go up to the start of the failure path: the block the condition of the assert branches to.
+            while (true) {
+                if (print_stats && !counted.add(bb)) {
+                    stats.size_estimate += estimate_block_size(bb);
+                }
+                if (!single_pred_p(bb) || single_pred(bb) == ENTRY_BLOCK_PTR_FOR_FN(fun) ||
+                    (single_pred_edge(bb)->flags & (EDGE_TRUE_VALUE | EDGE_FALSE_VALUE))) {
+                    break;
+                }
+                bb = single_pred(bb);
+            }
+
+            // && conditions have an edge into the failure path from each of their parts.
+            edge e;
+            edge_iterator ei;
+            FOR_EACH_EDGE(e, ei, bb->preds) {
+                if (e->flags & (EDGE_TRUE_VALUE | EDGE_FALSE_VALUE)) {
+                    // also zeroes the counts of the blocks dominated by the failure path.
+                    force_edge_cold(e, true);
+                }
+            }
+        }
+
+        return 0;
+    }
+};
+#endif
+
+#if GCCPLUGIN_VERSION >= 8001
+static const pass_data assert_policy_pass_data = {
+    GIMPLE_PASS,
+    "assert_introspect_policy", // name
+    OPTGROUP_NONE,
+    TV_NONE,
+    PROP_cfg | PROP_ssa, // properties_required
+    0, // properties_provided
+    0, // properties_destroyed
+    0, // todo_flags_start
+    0, // todo_flags_finish
+};
+
+// "<file>:<line>\t<count>\t<policy>" of each site.
+static auto_vec<char *> policy_lines;
+
+// for the "policy" argument: all sites were emitted sampled, with a period of 1 (see rewrite_assert). once the
+// profile is read, this pass sets the period of each site by the count of its guard block, or removes the check.
+struct assert_policy_pass : gimple_opt_pass {
+    assert_policy_pass(gcc::context *ctx) : gimple_opt_pass(assert_policy_pass_data, ctx) {
+    }
+
+    virtual unsigned int execute(function *fun) override {
+        // in the -fprofile-generate build, the sites stay fully checked.
+        if (profile_status_for_fn(fun) != PROFILE_READ) {
+            return 0;
+        }
+
+        // the resets of the countdowns ("__ai_sample_N = period;") start the checked part of each site.
+        auto_vec<gimple *> resets;
+        basic_block bb;
+        FOR_EACH_BB_FN(bb, fun) {
+            for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi); gsi_next(&gsi)) {
+                gimple *stmt = gsi_stmt(gsi);
+                if (gimple_assign_single_p(stmt) && sample_counters.contains(gimple_assign_lhs(stmt)) &&
+                    TREE_CODE(gimple_assign_rhs1(stmt)) == INTEGER_CST) {
+                    resets.safe_push(stmt);
+                }
+            }
+        }
+        if (resets.is_empty()) {
+            return 0;
+        }
+
+        calculate_dominance_info(CDI_DOMINATORS);
+
+        unsigned int todo = 0;
+        unsigned int i;
+        gimple *reset;
+        FOR_EACH_VEC_ELT(resets, i, reset) {
+            basic_block checked = gimple_bb(reset);
+            if (!single_pred_p(checked)) {
+                continue;
+            }
+            basic_block guard_bb = single_pred(checked);
+            gimple_stmt_iterator last = gsi_last_bb(guard_bb);
+            if (gsi_end_p(last) || gimple_code(gsi_stmt(last)) != GIMPLE_COND) {
+                continue;
+            }
+            gcond *guard = as_a<gcond *>(gsi_stmt(last));
+
+            // number of times the site was reached.
+            const profile_count count = guard_bb->count.ipa();
+            const unsigned long long n = count.initialized_p() ? count.to_gcov_type() : 0;
+            const char *policy;
+
+            if (n < policy_warm) {
+                policy = "checked";
+            } else if (n < policy_hot) {
+                policy = "sampled";
+                gimple_assign_set_rhs1(reset, build_int_cst(TREE_TYPE(gimple_assign_lhs(reset)),
+                    sample_period > 1 ? sample_period : 64));
+                update_stmt(reset);
+            } else {
+                tree counter = gimple_assign_lhs(reset);
+                if (policy_hot_assume) {
+                    // always evaluate the condition, and tell GCC it holds: the failure path becomes unreachable,
+                    // and the condition folds away where the optimizers can use it.
+                    policy = "assume";
+                    gimple_cond_make_true(guard);
+                    make_failure_unreachable(fun, checked);
+                } else {
+                    policy = "none";
+                    gimple_cond_make_false(guard);
+                }
+                update_stmt(guard);
+                remove_counter_stores(fun, counter);
+                todo |= TODO_cleanup_cfg | TODO_update_ssa_only_virtuals;
+            }
+
+            const expanded_location xloc = expand_location(gimple_location(reset));
+            policy_lines.safe_push(xasprintf("%s:%d\t%llu\t%s\n", xloc.file, xloc.line, n, policy));
+        }
+
+        if (todo != 0) {
+            free_dominance_info(CDI_DOMINATORS);
+        }
+        return todo;
+    }
+
+    // replaces the first failure statement (see is_failure_stmt) of the blocks dominated by 'checked' with
+    // __builtin_unreachable(). the rest of its block goes, CFG cleanup takes care of what's left unreachable.
+    static void make_failure_unreachable(function *fun, basic_block checked) {
+        basic_block bb;
+        FOR_EACH_BB_FN(bb, fun) {
+            if (!dominated_by_p(CDI_DOMINATORS, bb, checked)) {
+                continue;
+            }
+
+            for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi); gsi_next(&gsi)) {
+                if (is_failure_stmt(gsi_stmt(gsi))) {
+                    gcall *unreachable = gimple_build_call(builtin_decl_explicit(BUILT_IN_UNREACHABLE), 0);
+                    gimple_set_location(unreachable, gimple_location(gsi_stmt(gsi)));
+                    gsi_insert_before(&gsi, unreachable, GSI_SAME_STMT);
+
+                    // a noreturn call ends its block.
+                    edge e = split_block(bb, unreachable);
+                    remove_edge(e);
+                    break;
+                }
+            }
+        }
+    }
+
+    // the countdown of a site that isn't sampled anymore is dead, but its stores aren't removed on their own.
+    static void remove_counter_stores(function *fun, tree counter) {
+        basic_block bb;
+        FOR_EACH_BB_FN(bb, fun) {
+            for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi); ) {
+                gimple *stmt = gsi_stmt(gsi);
+                if (gimple_assign_single_p(stmt) && gimple_assign_lhs(stmt) == counter) {
+                    unlink_stmt_vdef(stmt);
+                    gsi_remove(&gsi, true);
+                    release_defs(stmt);
+                } else {
+                    gsi_next(&gsi);
+                }
+            }
+        }
+    }
+};
+
+static void policy_finish_callback(void *event_data, void *user_data) {
+    char *path = policy_report_file != NULL ? xstrdup(policy_report_file) :
+        concat(main_input_filename, ".ai-policy", NULL);
+    write_lines_file(path, policy_lines);
+    free(path);
+}
+
+// set by the "hoist" plugin argument, see assert_hoist_pass. "hoist=early" sets 'hoist_early' too: loops with effects
+// are hoisted from as well, and their failures are reported before the effects of the iterations that passed.
+static bool hoist_asserts;
+static bool hoist_early;
+
+static const pass_data assert_hoist_pass_data = {
+    GIMPLE_PASS,
+    "assert_introspect_hoist", // name
+    OPTGROUP_LOOP,
+    TV_NONE,
+    PROP_cfg | PROP_ssa, // properties_required
+    0, // properties_provided
+    0, // properties_destroyed
+    0, // todo_flags_start
+    0, // todo_flags_finish
+};
+
+// moves asserts out of loops: an assert whose condition is loop invariant, or an affine bound on an induction
+// variable (i < len), is checked once in the preheader instead of on each iteration. the branch to the failure
+// path is what keeps the vectorizer away from the loop.
+// a check in the preheader fails before the first iteration, where the one in the loop would have failed after
+// the iterations before it, so only loops without effects qualify (see has_no_effects_p), unless 'hoist_early'.
+// this runs after loop header copying, which only makes sure loops that don't run at all don't fail: their
+// preheader isn't reached.
+struct assert_hoist_pass : gimple_opt_pass {
+    assert_hoist_pass(gcc::context *ctx) : gimple_opt_pass(assert_hoist_pass_data, ctx) {
+    }
+
+    virtual unsigned int execute(function *fun) override {
+        if (number_of_loops(fun) <= 1) {
+            return 0;
+        }
+
+        loop_optimizer_init(LOOPS_NORMAL | LOOPS_HAVE_RECORDED_EXITS);
+        scev_initialize();
+        calculate_dominance_info(CDI_DOMINATORS);
+
+        // innermost first, so an assert hoisted out of an inner loop may be hoisted again out of the outer one.
+        unsigned int hoisted = 0;
+#if GCCPLUGIN_VERSION >= 12001
+        for (auto loop : loops_list(fun, LI_FROM_INNERMOST)) {
+#else
+        class loop *loop;
+        FOR_EACH_LOOP(loop, LI_FROM_INNERMOST) {
+#endif
+            hoisted += hoist_loop_asserts(loop);
+        }
+
+        scev_finalize();
+        loop_optimizer_finalize();
+
+        if (hoisted == 0) {
+            return 0;
+        }
+        // the failure paths use the memory state of the loop.
+        mark_virtual_operands_for_renaming(fun);
+        return TODO_update_ssa_only_virtuals | TODO_cleanup_cfg;
+    }
+
+    // whether 'op' has the same value in all iterations of 'loop', and is available before it.
+    static bool invariant_in_loop_p(class loop *loop, tree op) {
+        if (TREE_CODE(op) != SSA_NAME) {
+            return is_gimple_min_invariant(op);
+        }
+        return SSA_NAME_IS_DEFAULT_DEF(op) || !flow_bb_inside_loop_p(loop, gimple_bb(SSA_NAME_DEF_STMT(op)));
+    }
+
+    // whether 'fail' enters the failure path of an assert: a block entered only from the condition, which doesn't
+    // return (so it's not part of the loop).
+    static bool is_failure_path(edge fail) {
+        basic_block f = fail->dest;
+        if (!single_pred_p(f) || EDGE_COUNT(f->succs) != 0) {
+            return false;
+        }
+
+        for (gimple_stmt_iterator gsi = gsi_start_bb(f); !gsi_end_p(gsi); gsi_next(&gsi)) {
+            if (is_failure_stmt(gsi_stmt(gsi))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // whether the failure path only uses values available in the preheader, other than 'iv' which gets replaced.
+    static bool failure_path_movable_p(class loop *loop, basic_block f, tree iv) {
+        for (gimple_stmt_iterator gsi = gsi_start_bb(f); !gsi_end_p(gsi); gsi_next(&gsi)) {
+            ssa_op_iter iter;
+            tree op;
+            FOR_EACH_SSA_TREE_OPERAND(op, gsi_stmt(gsi), iter, SSA_OP_USE) {
+                if (op != iv && gimple_bb(SSA_NAME_DEF_STMT(op)) != f && !invariant_in_loop_p(loop, op)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // whether 'bb' runs on every iteration of 'loop', before the loop can be left.
+    static bool runs_every_iteration_p(class loop *loop, basic_block bb) {
+        if (bb->loop_father != loop || !dominated_by_p(CDI_DOMINATORS, loop->latch, bb)) {
+            return false;
+        }
+        for (struct loop_exit *exit = loop->exits->next; exit->e != NULL; exit = exit->next) {
+            if (!dominated_by_p(CDI_DOMINATORS, exit->e->src, bb)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // whether nothing 'loop' does is seen outside of it: no calls, volatile accesses or stores. the failure paths
+    // aren't part of the loop.
+    static bool has_no_effects_p(class loop *loop) {
+        basic_block *body = get_loop_body(loop);
+        bool none = true;
+        for (unsigned int i = 0; i < loop->num_nodes && none; i++) {
+            for (gimple_stmt_iterator gsi = gsi_start_bb(body[i]); !gsi_end_p(gsi); gsi_next(&gsi)) {
+                gimple *stmt = gsi_stmt(gsi);
+                if (is_gimple_call(stmt) || gimple_has_volatile_ops(stmt) || gimple_vdef(stmt) != NULL_TREE) {
+                    none = false;
+                    break;
+                }
+            }
+        }
+        free(body);
+
+        return none;
+    }
+
+    static unsigned int hoist_loop_asserts(class loop *loop) {
+        if (loop_preheader_edge(loop) == NULL || (!hoist_early && !has_no_effects_p(loop))) {
+            return 0;
+        }
+
+        unsigned int hoisted = 0;
+        basic_block *body = get_loop_body(loop);
+        const unsigned int n = loop->num_nodes;
+        for (unsigned int i = 0; i < n; i++) {
+            gimple_stmt_iterator last = gsi_last_bb(body[i]);
+            if (gsi_end_p(last) || gimple_code(gsi_stmt(last)) != GIMPLE_COND) {
+                continue;
+            }
+
+            if (hoist_assert(loop, as_a<gcond *>(gsi_stmt(last)))) {
+                hoisted++;
+                // we moved blocks around.
+                free_dominance_info(CDI_DOMINATORS);
+                calculate_dominance_info(CDI_DOMINATORS);
+            }
+        }
+        free(body);
+
+        return hoisted;
+    }
+
+    static bool hoist_assert(class loop *loop, gcond *cond) {
+        basic_block bb = gimple_bb(cond);
+        edge fail = EDGE_SUCC(bb, 0);
+        if (!is_failure_path(fail)) {
+            fail = EDGE_SUCC(bb, 1);
+            if (!is_failure_path(fail)) {
+                return false;
+            }
+        }
+        if (!runs_every_iteration_p(loop, bb)) {
+            return false;
+        }
+
+        // the condition under which the assert passes.
+        tree lhs = gimple_cond_lhs(cond);
+        tree rhs = gimple_cond_rhs(cond);
+        enum tree_code code = gimple_cond_code(cond);
+        if (fail->flags & EDGE_TRUE_VALUE) {
+            code = invert_tree_comparison(code, HONOR_NANS(lhs));
+            if (code == ERROR_MARK) {
+                return false;
+            }
+        }
+
+        if (invariant_in_loop_p(loop, lhs) && invariant_in_loop_p(loop, rhs)) {
+            if (!failure_path_movable_p(loop, fail->dest, NULL_TREE)) {
+                return false;
+            }
+            move_check(loop, cond, fail, code, lhs, rhs, NULL, NULL_TREE, NULL_TREE);
+            return true;
+        }
+
+        // an induction variable against an invariant bound: check the value which is the furthest from the bound.
+        if (invariant_in_loop_p(loop, lhs)) {
+            tree tmp = lhs;
+            lhs = rhs;
+            rhs = tmp;
+            code = swap_tree_comparison(code);
+        }
+        if (!invariant_in_loop_p(loop, rhs) || TREE_CODE(lhs) != SSA_NAME || !INTEGRAL_TYPE_P(TREE_TYPE(lhs)) ||
+            (code != LT_EXPR && code != LE_EXPR && code != GT_EXPR && code != GE_EXPR)) {
+            return false;
+        }
+
+        affine_iv iv;
+        if (!simple_iv(loop, loop, lhs, &iv, true) || !iv.no_overflow || TREE_CODE(iv.step) != INTEGER_CST ||
+            integer_zerop(iv.step)) {
+            return false;
+        }
+
+        tree type = TREE_TYPE(lhs);
+        tree worst = fold_convert(type, iv.base);
+        // increasing towards an upper bound, or decreasing towards a lower one: the last value is the worst.
+        if ((tree_int_cst_sgn(iv.step) > 0) == (code == LT_EXPR || code == LE_EXPR)) {
+            tree niter = number_of_latch_executions(loop);
+            if (chrec_contains_undetermined(niter)) {
+                return false;
+            }
+            worst = fold_build2(PLUS_EXPR, type, worst,
+                fold_build2(MULT_EXPR, type, fold_convert(type, niter), fold_convert(type, iv.step)));
+        }
+
+        if (!failure_path_movable_p(loop, fail->dest, lhs)) {
+            return false;
+        }
+
+        gimple_seq seq = NULL;
+        tree worst_value = force_gimple_operand(worst, &seq, true, NULL_TREE);
+        move_check(loop, cond, fail, code, worst_value, rhs, seq, lhs, worst_value);
+        return true;
+    }
+
+    // moves the check 'cond' & its failure path 'fail' to the preheader of 'loop', as "if (lhs <code> rhs) pass, else
+    // fail". 'seq' computes the operands. uses of 'iv' in the failure path are replaced with 'iv_value', so the message
+    // shows the value which fails.
+    static void move_check(class loop *loop, gcond *cond, edge fail, enum tree_code code, tree lhs, tree rhs,
+            gimple_seq seq, tree iv, tree iv_value) {
+        basic_block bb = gimple_bb(cond);
+        basic_block f = fail->dest;
+        const profile_probability fail_probability = fail->probability;
+
+        // a block of its own on the preheader edge, ending with the check.
+        basic_block check = split_edge(loop_preheader_edge(loop));
+        gimple_stmt_iterator gsi = gsi_last_bb(check);
+        gsi_insert_seq_after(&gsi, seq, GSI_CONTINUE_LINKING);
+        gcond *hoisted = gimple_build_cond(code, lhs, rhs, NULL_TREE, NULL_TREE);
+        gimple_set_location(hoisted, gimple_location(cond));
+        gsi_insert_after(&gsi, hoisted, GSI_NEW_STMT);
+
+        edge pass = single_succ_edge(check);
+        pass->flags = (pass->flags & ~EDGE_FALLTHRU) | EDGE_TRUE_VALUE;
+        pass->probability = fail_probability.invert();
+        edge moved = make_edge(check, f, EDGE_FALSE_VALUE);
+        moved->probability = fail_probability;
+        // the loop needs a preheader again.
+        split_edge(pass);
+
+        // in the loop, the assert always passes.
+        remove_edge(fail);
+        edge stay = single_succ_edge(bb);
+        stay->flags = (stay->flags & ~(EDGE_TRUE_VALUE | EDGE_FALSE_VALUE)) | EDGE_FALLTHRU;
+        stay->probability = profile_probability::always();
+        gimple_stmt_iterator cond_gsi = gsi_for_stmt(cond);
+        gsi_remove(&cond_gsi, true);
+
+        if (iv == NULL_TREE) {
+            return;
+        }
+        for (gsi = gsi_start_bb(f); !gsi_end_p(gsi); gsi_next(&gsi)) {
+            gimple *stmt = gsi_stmt(gsi);
+            use_operand_p use;
+            ssa_op_iter iter;
+            FOR_EACH_SSA_USE_OPERAND(use, stmt, iter, SSA_OP_USE) {
+                if (USE_FROM_PTR(use) == iv) {
+                    SET_USE(use, iv_value);
+                }
+            }
+            update_stmt(stmt);
+        }
+    }
+};
+#endif
+
+// parses -fplugin-arg-<name>-<key>=<value> arguments.
+static bool parse_plugin_args(const struct plugin_name_args *plugin_info) {
+    // (expression, file, line, function)
+    add_fail_fn("__assert_fail", "efln", NULL);
+
+    for (int i = 0; i < plugin_info->argc; i++) {
+        const struct plugin_argument *arg = &plugin_info->argv[i];
+
+        if (0 == strcmp(arg->key, "output") && arg->value != NULL) {
+            if (0 == strcmp(arg->value, "printf")) {
+                output_mode = OUTPUT_PRINTF;
+            } else if (0 == strcmp(arg->value, "write")) {
+                output_mode = OUTPUT_WRITE;
+            } else if (0 == strcmp(arg->value, "desc")) {
+                output_mode = OUTPUT_DESC;
+            } else if (0 == strcmp(arg->value, "binlog")) {
+                output_mode = OUTPUT_BINLOG;
+            } else {
+                error("%s: unknown output mode '%s'", plugin_info->base_name, arg->value);
+                return false;
+            }
+        } else if (0 == strcmp(arg->key, "mode") && arg->value != NULL) {
+            if (0 == strcmp(arg->value, "check")) {
+                assume_mode = false;
+            } else if (0 == strcmp(arg->value, "assume")) {
+                assume_mode = true;
+            } else {
+                error("%s: unknown mode '%s'", plugin_info->base_name, arg->value);
+                return false;
+            }
+        } else if (0 == strcmp(arg->key, "soft")) {
+            soft_limit = arg->value != NULL ? strtol(arg->value, NULL, 0) : 1;
+            if (soft_limit < 0 || soft_limit > UINT_MAX) {
+                error("%s: invalid soft limit '%s'", plugin_info->base_name, arg->value);
+                return false;
+            }
+        } else if (0 == strcmp(arg->key, "sample") && arg->value != NULL) {
+            sample_period = strtoul(arg->value, NULL, 0);
+            if (sample_period == 0 || sample_period > UINT_MAX) {
+                error("%s: invalid sample period '%s'", plugin_info->base_name, arg->value);
+                return false;
+            }
+        } else if (0 == strcmp(arg->key, "policy")) {
+            profile_policy = true;
+        } else if (0 == strcmp(arg->key, "warm") && arg->value != NULL) {
+            policy_warm = strtoull(arg->value, NULL, 0);
+        } else if (0 == strcmp(arg->key, "hot") && arg->value != NULL) {
+            policy_hot = strtoull(arg->value, NULL, 0);
+        } else if (0 == strcmp(arg->key, "hot-policy") && arg->value != NULL) {
+            if (0 == strcmp(arg->value, "assume")) {
+                policy_hot_assume = true;
+            } else if (0 == strcmp(arg->value, "none")) {
+                policy_hot_assume = false;
+            } else {
+                error("%s: unknown hot policy '%s'", plugin_info->base_name, arg->value);
+                return false;
+            }
+        } else if (0 == strcmp(arg->key, "policy-report") && arg->value != NULL) {
+            policy_report_file = arg->value;
+        } else if (0 == strcmp(arg->key, "counters")) {
+            count_sites = true;
+        } else if (0 == strcmp(arg->key, "hoist")) {
+            hoist_asserts = true;
+            if (arg->value != NULL) {
+                if (0 != strcmp(arg->value, "early")) {
+                    error("%s: unknown hoist mode '%s'", plugin_info->base_name, arg->value);
+                    return false;
+                }
+                hoist_early = true;
+            }
+        } else if (0 == strcmp(arg->key, "no-warn-always-false")) {
+            warn_always_false = false;
+        } else if (0 == strcmp(arg->key, "fail-fn") && arg->value != NULL) {
+            char *name = xstrdup(arg->value);
+            char *layout = strchr(name, ':');
+            char *pass = NULL;
+            if (layout != NULL) {
+                *layout++ = '\0';
+                pass = strchr(layout, ':');
+                if (pass != NULL) {
+                    *pass++ = '\0';
+                }
+            }
+            add_fail_fn(name, layout != NULL ? layout : "", pass != NULL && *pass != '\0' ? pass : NULL);
+        } else if (0 == strcmp(arg->key, "scope") && arg->value != NULL) {
+            if (0 == strcmp(arg->value, "all")) {
+                annotated_only = false;
+            } else if (0 == strcmp(arg->value, "annotated")) {
+                annotated_only = true;
+            } else {
+                error("%s: unknown scope '%s'", plugin_info->base_name, arg->value);
+                return false;
+            }
+        } else if (0 == strcmp(arg->key, "stats")) {
+            print_stats = true;
+            stats_file = arg->value;
+        } else if (0 == strcmp(arg->key, "sites-file") && arg->value != NULL) {
+            sites_file = arg->value;
+        } else if (0 == strcmp(arg->key, "buffer-size") && arg->value != NULL) {
+            output_buffer_size = strtoul(arg->value, NULL, 0);
+            if (output_buffer_size == 0) {
+                error("%s: invalid buffer size '%s'", plugin_info->base_name, arg->value);
+                return false;
+            }
+        } else {
+            error("%s: unknown argument '%s'", plugin_info->base_name, arg->key);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#define TREE_ROOT(var) { &var, 1, sizeof(var), &gt_ggc_mx_tree_node, &gt_pch_nx_tree_node }
+
+// the trees we keep across functions. they're all reachable from the TU too, except the literal pool, but a
+// collection may run before they're used (e.g. between two functions, when nothing refers to a decl yet).
+static const struct ggc_root_tab plugin_root_tab[] = {
+    TREE_ROOT(literal_pool_roots),
+    TREE_ROOT(printf_decl),
+    TREE_ROOT(output_buf),
+    TREE_ROOT(output_pos),
+    TREE_ROOT(write_decl),
+    { &fmt_decls[0], ARRAY_SIZE(fmt_decls), sizeof(fmt_decls[0]), &gt_ggc_mx_tree_node, &gt_pch_nx_tree_node },
+    TREE_ROOT(fmt_cmp_decl),
+    TREE_ROOT(format_cmp_decl),
+    TREE_ROOT(ai_report_decl),
+    TREE_ROOT(ai_log_decl),
+    TREE_ROOT(current_fndecl),
+    TREE_ROOT(soft_site_type),
+    TREE_ROOT(soft_site_count_field),
+    TREE_ROOT(counter_slot_type),
+    TREE_ROOT(counter_evaluations_field),
+    TREE_ROOT(counter_failures_field),
+    TREE_ROOT(counter_line_type),
+    TREE_ROOT(counter_line_slot_field),
+    TREE_ROOT(counter_site_type),
+    TREE_ROOT(counter_site_slot_field),
+    LAST_GGC_ROOT_TAB
+};
+
+#undef TREE_ROOT
+
+int plugin_init(struct plugin_name_args *plugin_info, struct plugin_gcc_version *version) {
+    printf("I'm loaded!, compiled for GCC %s\n", gcc_version.basever);
+    if (!parse_plugin_args(plugin_info)) {
+        return 1;
+    }
+
+    gcc_obstack_init(&tu_obstack);
+    gcc_obstack_init(&function_obstack);
+
+    register_callback(plugin_info->base_name, PLUGIN_ATTRIBUTES, attributes_callback, NULL);
+    register_callback(plugin_info->base_name, PLUGIN_PRAGMAS, pragmas_callback, NULL);
+    register_callback(plugin_info->base_name, PLUGIN_START_PARSE_FUNCTION, start_parse_function_callback, NULL);
+    register_callback(plugin_info->base_name, PLUGIN_PRE_GENERICIZE, pre_genericize_callback, NULL);
+    register_callback(plugin_info->base_name, PLUGIN_FINISH, finish_callback, NULL);
+    register_callback(plugin_info->base_name, PLUGIN_REGISTER_GGC_ROOTS, NULL, (void *)plugin_root_tab);
+
+#if GCCPLUGIN_VERSION >= 8001
+    // right after the profile is estimated: earlier, the estimation would overwrite what we set.
+    struct register_pass_info cold_pass_info;
+    cold_pass_info.pass = new assert_cold_pass(g);
+    cold_pass_info.reference_pass_name = "profile_estimate";
+    cold_pass_info.ref_pass_instance_number = 1;
+    cold_pass_info.pos_op = PASS_POS_INSERT_AFTER;
+    register_callback(plugin_info->base_name, PLUGIN_PASS_MANAGER_SETUP, NULL, &cold_pass_info);
+
+    if (profile_policy) {
+        // feedback_fnsplit runs right after the profile is read, and only with profiling flags.
+        struct register_pass_info policy_pass_info;
+        policy_pass_info.pass = new assert_policy_pass(g);
+        policy_pass_info.reference_pass_name = "feedback_fnsplit";
+        policy_pass_info.ref_pass_instance_number = 1;
+        policy_pass_info.pos_op = PASS_POS_INSERT_BEFORE;
+        register_callback(plugin_info->base_name, PLUGIN_PASS_MANAGER_SETUP, NULL, &policy_pass_info);
+        register_callback(plugin_info->base_name, PLUGIN_FINISH, policy_finish_callback, NULL);
+    }
+
+    if (hoist_asserts) {
+        struct register_pass_info hoist_pass_info;
+        hoist_pass_info.pass = new assert_hoist_pass(g);
+        hoist_pass_info.reference_pass_name = "ch";
+        hoist_pass_info.ref_pass_instance_number = 1;
+        hoist_pass_info.pos_op = PASS_POS_INSERT_AFTER;
+        register_callback(plugin_info->base_name, PLUGIN_PASS_MANAGER_SETUP, NULL, &hoist_pass_info);
+    }
+#endif
 
     return 0;
 }